@@ -0,0 +1,109 @@
+import os
+import sys
+import time
+import argparse
+import traceback
+import subprocess
+
+import numpy as np
+
+from stream_sync import StreamSynchronizer
+
+
+# Runs a coordinator and two ingest workers on 127.0.0.1. Every worker decodes
+# the given sources, the coordinator synchronizes the streams of both workers
+# and fetches the frames of some packets from the workers.
+#
+# Usage: python3 distributed_sync_demo.py --packets 100 rtsp://cam0 rtsp://cam1 ...
+
+
+def work(sources, port, worker_id):
+    cams = [{"source": source} for source in sources]
+    stream_synchronizer = StreamSynchronizer(cams,
+        coordinator="127.0.0.1:{}".format(port), worker_id=worker_id)
+    print("worker {}: publishing {} streams".format(worker_id, len(cams)))
+    sys.stdout.flush()
+
+    # the worker outputs no frame packets, the coordinator fetches its frames
+    while True:
+        time.sleep(1)
+
+
+def coordinate(coordinator, num_streams, num_packets, fetch_interval):
+    last_timestamp = None
+    max_dts = []
+    num_fetched = 0
+    for step in range(num_packets):
+        frame_packet = coordinator.get_frame_packet()
+        if len(frame_packet) != num_streams:
+            raise RuntimeError("Frame packet has {} instead of {} streams".format(len(frame_packet), num_streams))
+
+        # packets of the coordinator contain only metadata
+        timestamps = [frame_data["timestamp"] for frame_data in frame_packet.values()
+            if frame_data["frame_status"] == "FRAME_OKAY"]
+        if any(frame_data["frame"] is not None for frame_data in frame_packet.values()):
+            raise RuntimeError("Frame packet of the coordinator contains frames")
+
+        if timestamps:
+            if last_timestamp is not None and min(timestamps) < last_timestamp:
+                raise RuntimeError("Frame packets are not in timestamp order")
+            last_timestamp = min(timestamps)
+            max_dts.append(max(timestamps) - min(timestamps))
+
+        shapes = []
+        if step % fetch_interval == 0:
+            fetched = coordinator.fetch_frames(frame_packet)
+            for cap_id, frame_data in frame_packet.items():
+                fetched_data = fetched[cap_id]
+                if frame_data["frame_status"] != "FRAME_OKAY":
+                    continue
+                if fetched_data["frame_status"] != "FRAME_OKAY":
+                    print("coordinator: frame of stream {} not fetched ({})".format(cap_id, fetched_data["frame_status"]))
+                    continue
+                if fetched_data["timestamp"] != frame_data["timestamp"]:
+                    raise RuntimeError("Fetched frame of stream {} has a different timestamp".format(cap_id))
+                shapes.append(np.shape(fetched_data["frame"]))
+                num_fetched += 1
+
+        print("coordinator: packet {} | streams {} | fetched frame shapes {}".format(step, len(frame_packet), shapes))
+
+    print("N = {}".format(len(max_dts)))
+    print("mean dt_max = {}".format(np.mean(max_dts) if max_dts else float("nan")))
+    print("fetched frames = {}".format(num_fetched))
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Coordinator and two ingest workers on one machine")
+    parser.add_argument("sources", nargs="*", default=["vid.mp4", "vid.mp4"], help="stream URLs or video files of every worker")
+    parser.add_argument("--port", type=int, default=7400, help="TCP port of the coordinator")
+    parser.add_argument("--packets", type=int, default=100, help="number of frame packets to read")
+    parser.add_argument("--fetch-interval", type=int, default=10, help="fetch the frames of every n-th packet")
+    parser.add_argument("--worker", type=int, help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    num_workers = 2
+
+    if args.worker is not None:
+        try:
+            work(args.sources, args.port, args.worker)
+        except KeyboardInterrupt:
+            pass
+        os._exit(0)  # background threads of the synchronizer are not joined
+
+    # workers retry connecting until the coordinator listens
+    workers = [subprocess.Popen([sys.executable, __file__, "--worker", str(worker_id),
+        "--port", str(args.port)] + args.sources) for worker_id in range(num_workers)]
+    exit_code = 0
+    try:
+        coordinator = StreamSynchronizer([], coordinator_port=args.port, num_workers=num_workers)
+        coordinate(coordinator, num_workers * len(args.sources), args.packets, args.fetch_interval)
+    except Exception:
+        traceback.print_exc()
+        exit_code = 1
+    finally:
+        for worker in workers:
+            worker.terminate()
+            worker.wait()
+    sys.stdout.flush()
+    os._exit(exit_code)  # the coordinator is not destroyed, its background threads are not joined
@@ -12,9 +12,20 @@ stream_sync = Extension('stream_sync',
                     libraries = d['libraries'],
                     sources = ['src/py_stream_sync.cpp',
                                'src/stream_sync.cpp',
+                               'src/shm_packet_ring.cpp',
+                               'src/packet_dispatcher.cpp',
+                               'src/encoded_packet_recorder.cpp',
+                               'src/packet_recording.cpp',
+                               'src/thread_config.cpp',
+                               'src/motion_vectors.cpp',
+                               'src/clock_estimation.cpp',
+                               'src/worker_pool.cpp',
+                               'src/preprocessing.cpp',
+                               'src/mosaic.cpp',
+                               'src/distributed_sync.cpp',
                                '../video_cap/src/video_cap.cpp',
                                '../video_cap/src/time_cvt.cpp'],
-                    extra_compile_args = ['-std=c++17'],
+                    extra_compile_args = ['-std=c++17', '-ftree-vectorize'],
                     extra_link_args = ['-fPIC', '-Wl,-Bsymbolic'])
 
 setup (name = 'stream_sync',
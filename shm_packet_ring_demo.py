@@ -0,0 +1,106 @@
+import os
+import sys
+import time
+import argparse
+import subprocess
+
+import numpy as np
+
+from stream_sync import StreamSynchronizer, ShmPacketReader
+
+
+# Publishes frame packets into shared memory in one process and reads them
+# zero-copy with a ShmPacketReader in another process.
+#
+# Usage: python3 shm_packet_ring_demo.py --packets 100 rtsp://cam0 rtsp://cam1 ...
+
+
+def write(sources, shm_name):
+    cams = [{"source": source} for source in sources]
+    stream_synchronizer = StreamSynchronizer(cams, shm_name=shm_name)
+    print("writer: publishing into /dev/shm{}".format(shm_name))
+    sys.stdout.flush()
+
+    # the frame packet buffer drops old packets, the consumers read from shared memory
+    while True:
+        time.sleep(1)
+
+
+def remove_ring(shm_name):
+    # the writer is killed and can not unlink the ring itself
+    try:
+        os.remove("/dev/shm" + shm_name)
+    except FileNotFoundError:
+        pass
+
+
+def read(shm_name, num_packets, timeout):
+    # the ring exists once the writer finished initializing its streams
+    deadline = time.time() + timeout
+    while True:
+        try:
+            reader = ShmPacketReader(shm_name)
+            break
+        except RuntimeError:
+            if time.time() > deadline:
+                raise
+            time.sleep(0.1)
+
+    last_timestamp = None
+    max_dts = []
+    num_invalid = 0
+    for step in range(num_packets):
+        frame_packet = reader.get_frame_packet(timeout=timeout)
+        if frame_packet is None:
+            raise RuntimeError("No frame packet within {} seconds".format(timeout))
+
+        timestamps = [frame_data["timestamp"] for frame_data in frame_packet.values()
+            if frame_data["frame_status"] == "FRAME_OKAY"]
+        shapes = [np.shape(frame_data["frame"]) for frame_data in frame_packet.values()
+            if frame_data["frame_status"] == "FRAME_OKAY"]
+
+        # the arrays reference the ring, check they were not overwritten while in use
+        if not reader.is_valid():
+            num_invalid += 1
+            continue
+
+        if timestamps:
+            if last_timestamp is not None and min(timestamps) < last_timestamp:
+                raise RuntimeError("Frame packets are not in timestamp order")
+            last_timestamp = min(timestamps)
+            max_dts.append(max(timestamps) - min(timestamps))
+
+        print("reader: packet {} | streams {} | frame shapes {}".format(step, len(frame_packet), shapes))
+
+    print("N = {}".format(len(max_dts)))
+    print("mean dt_max = {}".format(np.mean(max_dts) if max_dts else float("nan")))
+    print("overwritten packets = {}".format(num_invalid))
+    print("overruns = {}".format(reader.overruns()))
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Shared memory writer and reader in two processes")
+    parser.add_argument("sources", nargs="*", default=["vid.mp4", "vid.mp4"], help="stream URLs or video files")
+    parser.add_argument("--shm-name", default="/stream_sync_demo", help="name of the shared memory ring")
+    parser.add_argument("--packets", type=int, default=100, help="number of frame packets to read")
+    parser.add_argument("--timeout", type=float, default=30, help="seconds to wait for the writer")
+    parser.add_argument("--write", action="store_true", help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.write:
+        try:
+            write(args.sources, args.shm_name)
+        except KeyboardInterrupt:
+            pass
+        os._exit(0)  # background threads of the synchronizer are not joined
+
+    remove_ring(args.shm_name)
+    writer = subprocess.Popen([sys.executable, __file__, "--write",
+        "--shm-name", args.shm_name] + args.sources)
+    try:
+        read(args.shm_name, args.packets, args.timeout)
+    finally:
+        writer.terminate()
+        writer.wait()
+        remove_ring(args.shm_name)
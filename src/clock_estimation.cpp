@@ -0,0 +1,103 @@
+#include "clock_estimation.hpp"
+
+#include <algorithm>
+
+
+ClockEstimator::ClockEstimator(double window, double bucket_duration, std::size_t min_buckets) :
+    window(window),
+    bucket_duration(bucket_duration),
+    min_buckets(std::max(min_buckets, (std::size_t)1)) {}
+
+
+void ClockEstimator::add(double timestamp, double arrival_time) {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+
+    double difference = timestamp - arrival_time;
+    this->last_arrival_time = arrival_time;
+
+    if(this->buckets.empty() || arrival_time >= this->buckets.back().start + this->bucket_duration) {
+        // the previous bucket is complete, drop buckets which left the window and refit
+        this->buckets.push_back({arrival_time, arrival_time, difference, 1});
+        while(this->buckets.front().start < arrival_time - this->window)
+            this->buckets.pop_front();
+        this->fit();
+        return;
+    }
+
+    Bucket& bucket = this->buckets.back();
+    bucket.num_samples++;
+    if(difference > bucket.difference) {
+        bucket.difference = difference;
+        bucket.arrival_time = arrival_time;
+    }
+}
+
+
+void ClockEstimator::fit(void) {
+    std::size_t n = this->buckets.size() - 1;  // without the bucket being filled
+    if(n < this->min_buckets)
+        return;
+
+    // center times for numerical stability of UNIX timestamps
+    double mean_time = 0;
+    double mean_difference = 0;
+    for(std::size_t i = 0; i < n; i++) {
+        mean_time += this->buckets[i].arrival_time;
+        mean_difference += this->buckets[i].difference;
+    }
+    mean_time /= n;
+    mean_difference /= n;
+
+    double covariance = 0;
+    double variance = 0;
+    for(std::size_t i = 0; i < n; i++) {
+        double dt = this->buckets[i].arrival_time - mean_time;
+        covariance += dt * (this->buckets[i].difference - mean_difference);
+        variance += dt * dt;
+    }
+
+    this->fit_time = mean_time;
+    this->fit_offset = mean_difference;
+    this->fit_drift = variance > 0 ? covariance / variance : 0;
+
+    // later changes of the offset are measured against the first fit
+    if(!this->valid)
+        this->baseline_offset = this->fit_offset + this->fit_drift * (this->last_arrival_time - this->fit_time);
+    this->valid = true;
+}
+
+
+double ClockEstimator::offset_at(double time) const {
+    if(this->valid)
+        return this->fit_offset + this->fit_drift * (time - this->fit_time);
+
+    double max_difference = this->buckets.front().difference;
+    for(const Bucket& bucket : this->buckets)
+        max_difference = std::max(max_difference, bucket.difference);
+    return max_difference;
+}
+
+
+bool ClockEstimator::offset_change(double time, double& change) const {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if(!this->valid)
+        return false;
+    change = this->offset_at(time) - this->baseline_offset;
+    return true;
+}
+
+
+ClockEstimate ClockEstimator::estimate(void) const {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+
+    ClockEstimate estimate = {this->valid, 0, 0, 0, 0};
+    if(this->buckets.empty())
+        return estimate;
+
+    // offset at the most recent arrival
+    estimate.offset = this->offset_at(this->last_arrival_time);
+    estimate.drift = this->fit_drift;
+    for(const Bucket& bucket : this->buckets)
+        estimate.num_samples += bucket.num_samples;
+    return estimate;
+}
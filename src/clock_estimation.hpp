@@ -0,0 +1,84 @@
+#ifndef CLOCK_ESTIMATION_H
+#define CLOCK_ESTIMATION_H
+
+#include <deque>
+#include <mutex>
+#include <cstddef>
+
+/*
+*    Online estimation of the clock offset and drift of a stream
+*
+*    For every frame the difference between its timestamp (camera clock) and
+*    its arrival time (host clock) is observed. This difference is the clock
+*    offset minus the transmission and decoding latency of the frame. As the
+*    latency is always positive, the maximum difference within short buckets
+*    approximates the offset minus the minimum latency. A least squares line
+*    through the bucket maxima of the last window seconds yields offset and
+*    drift, which are updated whenever a bucket completes.
+*
+*    Differences in minimum latency between streams can not be distinguished
+*    from clock offsets and remain in the estimate. Timestamps are therefore
+*    only corrected by the change of the offset since the estimate became
+*    valid, which is caused by drift and clock steps, not by latency.
+*
+*/
+
+#define CLOCK_HOST_REFERENCE  -1  // correct timestamps to the host clock instead of a reference stream
+
+struct ClockEstimate {
+    bool valid;  // enough buckets were observed for a fit
+    double offset;  // stream clock minus host clock (minus minimum latency) in seconds
+    double drift;  // change of the offset in seconds per second
+    double correction;  // seconds currently subtracted from the timestamps of the stream, 0 if not corrected
+    std::size_t num_samples;  // frames observed within the window
+};
+
+class ClockEstimator {
+
+private:
+
+    struct Bucket {
+        double start;  // arrival time of the first frame
+        double arrival_time;  // arrival time of the frame with the maximum difference
+        double difference;  // maximum of timestamp - arrival time
+        std::size_t num_samples;
+    };
+
+    double window;
+    double bucket_duration;
+    std::size_t min_buckets;
+    std::deque<Bucket> buckets;  // the last bucket is still being filled
+    double last_arrival_time = 0;
+
+    /* line fitted through the completed buckets */
+    bool valid = false;
+    double fit_time = 0;
+    double fit_offset = 0;
+    double fit_drift = 0;
+    double baseline_offset = 0;  // offset when the estimate became valid
+
+    mutable std::mutex mutex_;
+
+    /* least squares fit of the completed buckets (called with mutex_ held) */
+    void fit(void);
+
+    /* offset at the given host time (called with mutex_ held) */
+    double offset_at(double time) const;
+
+public:
+
+    /* window and bucket_duration in seconds, the estimate becomes valid after min_buckets buckets */
+    ClockEstimator(double window = 60, double bucket_duration = 1, std::size_t min_buckets = 5);
+
+    /* adds the timestamp of a frame and its arrival time on the host (both UNIX time) */
+    void add(double timestamp, double arrival_time);
+
+    /* change of the offset at the given host time since the estimate became
+    valid, returns false until it is valid */
+    bool offset_change(double time, double& change) const;
+
+    /* current estimate, correction is left at 0 */
+    ClockEstimate estimate(void) const;
+};
+
+#endif
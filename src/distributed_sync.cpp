@@ -0,0 +1,568 @@
+#include "distributed_sync.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "exceptions.hpp"
+
+
+static std::string socket_error(const std::string& what) {
+    return what + ": " + strerror(errno);
+}
+
+
+static bool send_all(int fd, const void *data, std::size_t size) {
+    const uint8_t *ptr = static_cast<const uint8_t*>(data);
+    while(size > 0) {
+        ssize_t ret = send(fd, ptr, size, MSG_NOSIGNAL);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0)
+            return false;
+        ptr += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+
+// returns false on error or if the peer closed the connection
+static bool recv_all(int fd, void *data, std::size_t size) {
+    uint8_t *ptr = static_cast<uint8_t*>(data);
+    while(size > 0) {
+        ssize_t ret = recv(fd, ptr, size, 0);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0)
+            return false;
+        ptr += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+
+// reads and discards size bytes, returns false on error or if the peer closed the connection
+static bool discard_all(int fd, std::size_t size) {
+    uint8_t buffer[4096];
+    while(size > 0) {
+        std::size_t chunk = std::min(size, sizeof(buffer));
+        if(!recv_all(fd, buffer, chunk))
+            return false;
+        size -= chunk;
+    }
+    return true;
+}
+
+
+// small messages are sent immediately instead of being batched by Nagle's algorithm
+static void set_no_delay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+
+static void close_socket(int& fd) {
+    if(fd >= 0) {
+        shutdown(fd, SHUT_RDWR);  // unblocks threads waiting in recv
+        close(fd);
+        fd = -1;
+    }
+}
+
+
+static int connect_to(const std::string& address, double timeout) {
+    std::size_t colon = address.rfind(':');
+    if(colon == std::string::npos)
+        throw StreamProcessingError("Coordinator address \"" + address + "\" is not of the form host:port");
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    // the coordinator might not listen yet if all processes are started together
+    auto start = std::chrono::steady_clock::now();
+    while(1) {
+        struct addrinfo *addresses = NULL;
+        int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+        if(ret != 0)
+            throw StreamProcessingError("Could not resolve coordinator address \"" + address + "\": " + gai_strerror(ret));
+
+        for(struct addrinfo *ai = addresses; ai != NULL; ai = ai->ai_next) {
+            int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if(fd < 0)
+                continue;
+            if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+                freeaddrinfo(addresses);
+                set_no_delay(fd);
+                return fd;
+            }
+            close(fd);
+        }
+        freeaddrinfo(addresses);
+
+        if(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > timeout)
+            throw StreamProcessingError(socket_error("Could not connect to coordinator \"" + address + "\""));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+
+IngestPublisher::IngestPublisher(const std::string& address, int worker_id, std::size_t num_streams,
+    std::size_t max_pending_frames, std::size_t max_matched_frames,
+    double connect_timeout, const ThreadConfig& thread_config) :
+    metadata_fd(-1),
+    fetch_fd(-1),
+    max_pending_frames(max_pending_frames),
+    max_matched_frames(max_matched_frames),
+    streams(num_streams),
+    connected(true),
+    thread_config(thread_config) {
+
+    DSyncHello hello = {DSYNC_MAGIC, DSYNC_CHANNEL_METADATA, (uint32_t)worker_id, (uint32_t)num_streams};
+    this->metadata_fd = connect_to(address, connect_timeout);
+    if(!send_all(this->metadata_fd, &hello, sizeof(hello))) {
+        close_socket(this->metadata_fd);
+        throw StreamProcessingError(socket_error("Could not register with coordinator \"" + address + "\""));
+    }
+
+    hello.channel = DSYNC_CHANNEL_FETCH;
+    this->fetch_fd = connect_to(address, connect_timeout);
+    if(!send_all(this->fetch_fd, &hello, sizeof(hello))) {
+        close_socket(this->metadata_fd);
+        close_socket(this->fetch_fd);
+        throw StreamProcessingError(socket_error("Could not register with coordinator \"" + address + "\""));
+    }
+
+    this->match_thread = std::thread(&IngestPublisher::receive_matches, this);
+    this->fetch_thread = std::thread(&IngestPublisher::serve_fetches, this);
+}
+
+
+IngestPublisher::~IngestPublisher() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->connected = false;
+        shutdown(this->metadata_fd, SHUT_RDWR);
+        shutdown(this->fetch_fd, SHUT_RDWR);
+    }
+    if(this->match_thread.joinable())
+        this->match_thread.join();
+    if(this->fetch_thread.joinable())
+        this->fetch_thread.join();
+    close_socket(this->metadata_fd);
+    close_socket(this->fetch_fd);
+}
+
+
+void IngestPublisher::send_metadata(const DSyncMetadata& metadata) {
+    if(!this->connected)
+        return;
+    if(!send_all(this->metadata_fd, &metadata, sizeof(metadata))) {
+        std::cerr << "Lost connection to the coordinator." << std::endl;
+        this->connected = false;
+    }
+}
+
+
+void IngestPublisher::publish(std::size_t stream, const std::shared_ptr<FrameData>& frame_data) {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    StreamFrames& frames = this->streams[stream];
+
+    (*frame_data).sequence = frames.next_sequence++;
+
+    DSyncMetadata metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.stream = (uint32_t)stream;
+    metadata.frame_status = (*frame_data).frame_status;
+    metadata.sequence = (*frame_data).sequence;
+    if((*frame_data).frame_status == FRAME_OKAY) {
+        metadata.timestamp = (*frame_data).timestamp;
+        memcpy(metadata.frame_type, (*frame_data).frame_type, sizeof(metadata.frame_type));
+
+        // only valid frames can be matched, without a coordinator none is
+        if(this->connected) {
+            frames.pending.push_back(frame_data);
+            if(frames.pending.size() > this->max_pending_frames)
+                frames.pending.pop_front();
+        }
+    }
+    this->send_metadata(metadata);
+}
+
+
+void IngestPublisher::publish_broken(std::size_t stream) {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    DSyncMetadata metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.stream = (uint32_t)stream;
+    metadata.frame_status = CAP_BROKEN;
+    this->send_metadata(metadata);
+}
+
+
+void IngestPublisher::receive_matches(void) {
+    apply_thread_config(this->thread_config, "ss_match");
+
+    DSyncFrameRef ref;
+    while(recv_all(this->metadata_fd, &ref, sizeof(ref))) {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        if(ref.stream >= this->streams.size())
+            continue;
+        StreamFrames& frames = this->streams[ref.stream];
+
+        // frames are matched in order, so all older pending frames were skipped
+        while(!frames.pending.empty() && (*frames.pending.front()).sequence < ref.sequence)
+            frames.pending.pop_front();
+        if(frames.pending.empty() || (*frames.pending.front()).sequence != ref.sequence)
+            continue;  // released already
+
+        frames.matched.push_back(std::move(frames.pending.front()));
+        frames.pending.pop_front();
+        if(frames.matched.size() > this->max_matched_frames)
+            frames.matched.pop_front();
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if(this->connected)
+        std::cerr << "Lost connection to the coordinator." << std::endl;
+    this->connected = false;
+    for(StreamFrames& frames : this->streams) {
+        frames.pending.clear();
+        frames.matched.clear();
+    }
+}
+
+
+void IngestPublisher::serve_fetches(void) {
+    apply_thread_config(this->thread_config, "ss_fetch");
+
+    DSyncFetchRequest request;
+    while(recv_all(this->fetch_fd, &request, sizeof(request))) {
+
+        // the coordinator requests at most one frame per stream
+        if(request.num_frames > this->streams.size()) {
+            std::cerr << "Invalid fetch request of " << request.num_frames << " frames from the coordinator." << std::endl;
+            break;
+        }
+        std::vector<DSyncFrameRef> refs(request.num_frames);
+        if(!recv_all(this->fetch_fd, refs.data(), refs.size() * sizeof(DSyncFrameRef)))
+            break;
+
+        // look up the frames, the match of a frame may still be on its way on
+        // the metadata connection, so pending frames are searched as well
+        std::vector<std::shared_ptr<FrameData> > frames(refs.size());
+        {
+            std::lock_guard<std::mutex> lock(this->mutex_);
+            for(std::size_t i = 0; i < refs.size(); i++) {
+                if(refs[i].stream >= this->streams.size())
+                    continue;
+                for(auto* queue : {&this->streams[refs[i].stream].matched, &this->streams[refs[i].stream].pending}) {
+                    for(const std::shared_ptr<FrameData>& frame_data : *queue) {
+                        if((*frame_data).sequence == refs[i].sequence)
+                            frames[i] = frame_data;
+                    }
+                }
+            }
+        }
+
+        // frames are sent without holding the lock, the shared pointers keep them alive
+        bool success = true;
+        for(std::size_t i = 0; i < frames.size() && success; i++) {
+            DSyncFrameHeader header;
+            memset(&header, 0, sizeof(header));
+            if(!frames[i]) {
+                header.frame_status = FRAME_DROPPED;
+                success = send_all(this->fetch_fd, &header, sizeof(header));
+                continue;
+            }
+            const FrameData& frame_data = *frames[i];
+            header.frame_status = frame_data.frame_status;
+            header.height = frame_data.height;
+            header.width = frame_data.width;
+            memcpy(header.frame_type, frame_data.frame_type, sizeof(header.frame_type));
+            header.timestamp = frame_data.timestamp;
+            header.num_mvs = frame_data.num_mvs;
+            success = send_all(this->fetch_fd, &header, sizeof(header))
+                && send_all(this->fetch_fd, frame_data.frame, (std::size_t)frame_data.height * frame_data.width * 3)
+                && send_all(this->fetch_fd, frame_data.motion_vectors, (std::size_t)frame_data.num_mvs * 10 * sizeof(MVS_DTYPE));
+        }
+        if(!success)
+            break;
+    }
+}
+
+
+CoordinatorServer::CoordinatorServer(int port, std::size_t num_workers) {
+
+    int listen_fd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listen_fd < 0)
+        throw StreamProcessingError(socket_error("Could not create coordinator socket"));
+
+    // accept IPv4 and IPv6 connections and allow an immediate restart
+    int zero = 0;
+    int one = 1;
+    setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if(bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0) {
+        std::string error = socket_error("Could not listen on port " + std::to_string(port));
+        close(listen_fd);
+        throw StreamProcessingError(error);
+    }
+
+    for(std::size_t i = 0; i < num_workers; i++)
+        this->workers.push_back(std::make_unique<Worker>());
+
+    // every worker opens a metadata and a fetch connection
+    std::cout << "Waiting for " << num_workers << " ingest workers to connect... ";
+    std::cout.flush();
+    std::size_t num_connections = 0;
+    while(num_connections < 2 * num_workers) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno == EINTR)
+                continue;
+            std::string error = socket_error("Could not accept ingest worker");
+            close(listen_fd);
+            throw StreamProcessingError(error);
+        }
+        set_no_delay(fd);
+
+        DSyncHello hello;
+        if(!recv_all(fd, &hello, sizeof(hello)) || hello.magic != DSYNC_MAGIC
+            || hello.worker_id >= num_workers || hello.channel > DSYNC_CHANNEL_FETCH) {
+            std::cerr << "Rejected invalid ingest worker connection." << std::endl;
+            close(fd);
+            continue;
+        }
+
+        Worker& worker = *this->workers[hello.worker_id];
+        int& worker_fd = hello.channel == DSYNC_CHANNEL_METADATA ? worker.metadata_fd : worker.fetch_fd;
+        if(worker_fd >= 0 || ((worker.metadata_fd >= 0 || worker.fetch_fd >= 0) && worker.num_streams != hello.num_streams)) {
+            std::cerr << "Rejected duplicate connection of ingest worker " << hello.worker_id << "." << std::endl;
+            close(fd);
+            continue;
+        }
+        worker_fd = fd;
+        worker.num_streams = hello.num_streams;
+        num_connections++;
+    }
+    close(listen_fd);
+    std::cout << "[OK]" << std::endl;
+
+    for(std::size_t worker_id = 0; worker_id < num_workers; worker_id++) {
+        this->workers[worker_id]->first_cap_id = this->stream_workers.size();
+        this->stream_workers.insert(this->stream_workers.end(), this->workers[worker_id]->num_streams, worker_id);
+    }
+    this->stream_valid.reset(new std::atomic<bool>[this->stream_workers.size()]);
+    for(std::size_t cap_id = 0; cap_id < this->stream_workers.size(); cap_id++)
+        this->stream_valid[cap_id] = true;
+}
+
+
+CoordinatorServer::~CoordinatorServer() {
+    for(std::unique_ptr<Worker>& worker : this->workers) {
+        shutdown(worker->metadata_fd, SHUT_RDWR);
+        shutdown(worker->fetch_fd, SHUT_RDWR);
+    }
+    for(std::thread& thread : this->threads)
+        thread.join();
+    for(std::unique_ptr<Worker>& worker : this->workers) {
+        close_socket(worker->metadata_fd);
+        close_socket(worker->fetch_fd);
+    }
+}
+
+
+std::size_t CoordinatorServer::num_streams(void) const {
+    return this->stream_workers.size();
+}
+
+
+bool CoordinatorServer::stream_is_valid(std::size_t cap_id) const {
+    return this->stream_valid[cap_id];
+}
+
+
+void CoordinatorServer::start(DSyncMetadataCallback callback, const ThreadConfig& thread_config) {
+    for(std::size_t worker_id = 0; worker_id < this->workers.size(); worker_id++) {
+        this->threads.push_back(std::thread(&CoordinatorServer::receive_metadata, this,
+            worker_id, callback, thread_config));
+    }
+}
+
+
+void CoordinatorServer::receive_metadata(std::size_t worker_id, DSyncMetadataCallback callback, ThreadConfig thread_config) {
+    apply_thread_config(thread_config, "ss_coord_" + std::to_string(worker_id));
+
+    Worker& worker = *this->workers[worker_id];
+    DSyncMetadata metadata;
+    while(recv_all(worker.metadata_fd, &metadata, sizeof(metadata))) {
+        if(metadata.stream >= worker.num_streams)
+            continue;
+
+        std::shared_ptr<FrameData> frame_data = std::make_shared<FrameData>();
+        (*frame_data).cap_id = (int)(worker.first_cap_id + metadata.stream);
+        (*frame_data).sequence = metadata.sequence;
+        (*frame_data).frame_status = metadata.frame_status;
+        (*frame_data).timestamp = metadata.timestamp;
+        (*frame_data).height = 0;
+        (*frame_data).width = 0;
+        (*frame_data).num_mvs = 0;
+        memcpy((*frame_data).frame_type, metadata.frame_type, sizeof((*frame_data).frame_type));
+        (*frame_data).frame_type[1] = '\0';
+
+        if(metadata.frame_status == CAP_BROKEN)
+            this->stream_valid[(*frame_data).cap_id] = false;
+        callback(std::move(frame_data));
+    }
+
+    // all streams of a lost worker are broken
+    std::cerr << "Lost connection to ingest worker " << worker_id << "." << std::endl;
+    worker.lost = true;
+    for(std::size_t stream = 0; stream < worker.num_streams; stream++) {
+        std::shared_ptr<FrameData> frame_data = std::make_shared<FrameData>();
+        (*frame_data).cap_id = (int)(worker.first_cap_id + stream);
+        (*frame_data).frame_status = CAP_BROKEN;
+        this->stream_valid[(*frame_data).cap_id] = false;
+        callback(std::move(frame_data));
+    }
+}
+
+
+void CoordinatorServer::send_matches(const SSFramePacket& frame_packet) {
+    for(const std::shared_ptr<FrameData>& frame_data : frame_packet) {
+        if((*frame_data).frame_status != FRAME_OKAY || (*frame_data).sequence == 0)
+            continue;
+
+        Worker& worker = *this->workers[this->stream_workers[(*frame_data).cap_id]];
+        DSyncFrameRef ref = {(uint32_t)((*frame_data).cap_id - worker.first_cap_id), 0, (*frame_data).sequence};
+        std::lock_guard<std::mutex> lock(worker.send_mutex);
+        send_all(worker.metadata_fd, &ref, sizeof(ref));  // a lost worker is detected by its receiver thread
+    }
+}
+
+
+void CoordinatorServer::fetch(const SSFramePacket& frame_packet, SSFramePacket& fetched) {
+
+    fetched = frame_packet;
+
+    // frames to fetch grouped by worker
+    std::vector<std::vector<std::size_t> > requested(this->workers.size());
+    for(std::size_t i = 0; i < frame_packet.size(); i++) {
+        const FrameData& frame_data = *frame_packet[i];
+        if(frame_data.frame_status == FRAME_OKAY && frame_data.sequence > 0
+            && frame_data.cap_id >= 0 && (std::size_t)frame_data.cap_id < this->stream_workers.size())
+            requested[this->stream_workers[frame_data.cap_id]].push_back(i);
+    }
+
+    // send all requests first, so that the workers serve them concurrently,
+    // fetch mutexes are always locked in worker order
+    std::vector<std::unique_lock<std::mutex> > locks;
+    std::vector<bool> sent(this->workers.size(), false);
+    std::vector<bool> lost(this->workers.size(), false);
+    for(std::size_t worker_id = 0; worker_id < this->workers.size(); worker_id++) {
+        Worker& worker = *this->workers[worker_id];
+        lost[worker_id] = worker.lost;
+        if(requested[worker_id].empty() || lost[worker_id])
+            continue;
+        locks.emplace_back(worker.fetch_mutex);
+
+        DSyncFetchRequest request = {(uint32_t)requested[worker_id].size(), 0};
+        std::vector<DSyncFrameRef> refs;
+        for(std::size_t i : requested[worker_id]) {
+            refs.push_back({(uint32_t)(frame_packet[i]->cap_id - worker.first_cap_id), 0, frame_packet[i]->sequence});
+        }
+        sent[worker_id] = send_all(worker.fetch_fd, &request, sizeof(request))
+            && send_all(worker.fetch_fd, refs.data(), refs.size() * sizeof(DSyncFrameRef));
+    }
+
+    for(std::size_t worker_id = 0; worker_id < this->workers.size(); worker_id++) {
+        Worker& worker = *this->workers[worker_id];
+        bool success = sent[worker_id];
+        for(std::size_t i : requested[worker_id]) {
+            std::shared_ptr<FrameData> frame_data = std::make_shared<FrameData>();
+            (*frame_data).cap_id = frame_packet[i]->cap_id;
+            (*frame_data).sequence = frame_packet[i]->sequence;
+            (*frame_data).timestamp = frame_packet[i]->timestamp;
+            memcpy((*frame_data).frame_type, frame_packet[i]->frame_type, sizeof((*frame_data).frame_type));
+            (*frame_data).frame_status = success ? FRAME_DROPPED : CAP_BROKEN;
+
+            DSyncFrameHeader header;
+            if(success && (success = recv_all(worker.fetch_fd, &header, sizeof(header)))
+                && header.frame_status != FRAME_DROPPED) {
+                // frame type and timestamp as decoded by the worker
+                (*frame_data).timestamp = header.timestamp;
+                memcpy((*frame_data).frame_type, header.frame_type, sizeof((*frame_data).frame_type));
+                (*frame_data).frame_type[1] = '\0';
+            }
+            if(success && header.frame_status == FRAME_OKAY) {
+                // a corrupted header can not be skipped, the connection is out of sync
+                // (at most two motion vectors per 4x4 block)
+                if(header.height <= 0 || header.height > DSYNC_MAX_FRAME_DIMENSION
+                    || header.width <= 0 || header.width > DSYNC_MAX_FRAME_DIMENSION
+                    || header.num_mvs < 0 || header.num_mvs > 2 * (int64_t)(header.height / 4 + 1) * (header.width / 4 + 1)) {
+                    std::cerr << "Invalid frame header from ingest worker " << worker_id << "." << std::endl;
+                    success = false;
+                }
+            }
+            if(success && header.frame_status == FRAME_OKAY) {
+                std::size_t frame_size = (std::size_t)header.height * header.width * 3;
+                std::size_t mvs_size = (std::size_t)header.num_mvs * 10 * sizeof(MVS_DTYPE);
+                (*frame_data).frame = (uint8_t*)malloc(frame_size);
+                (*frame_data).motion_vectors = (MVS_DTYPE*)malloc(std::max(mvs_size, sizeof(MVS_DTYPE)));
+                if(!(*frame_data).frame || !(*frame_data).motion_vectors) {
+                    // the frame is skipped, the connection stays usable
+                    std::cerr << "Could not allocate a frame fetched from ingest worker " << worker_id << "." << std::endl;
+                    free((*frame_data).frame);
+                    free((*frame_data).motion_vectors);
+                    (*frame_data).frame = NULL;
+                    (*frame_data).motion_vectors = NULL;
+                    success = discard_all(worker.fetch_fd, frame_size + mvs_size);
+                }
+                else {
+                    success = recv_all(worker.fetch_fd, (*frame_data).frame, frame_size)
+                        && recv_all(worker.fetch_fd, (*frame_data).motion_vectors, mvs_size);
+                    if(success) {
+                        (*frame_data).height = header.height;
+                        (*frame_data).width = header.width;
+                        (*frame_data).num_mvs = header.num_mvs;
+                        (*frame_data).frame_status = FRAME_OKAY;
+                    }
+                }
+            }
+            if(!success)
+                (*frame_data).frame_status = CAP_BROKEN;
+            fetched[i] = std::move(frame_data);
+        }
+
+        // a partially received response leaves the connection unusable, the worker is
+        // dropped and its receiver thread reports its streams as broken
+        if(!requested[worker_id].empty() && !lost[worker_id] && !success) {
+            std::cerr << "Could not fetch frames from ingest worker " << worker_id << "." << std::endl;
+            worker.lost = true;
+            for(std::size_t stream = 0; stream < worker.num_streams; stream++) {
+                this->stream_valid[worker.first_cap_id + stream] = false;
+            }
+            shutdown(worker.fetch_fd, SHUT_RDWR);
+            shutdown(worker.metadata_fd, SHUT_RDWR);
+        }
+    }
+}
@@ -0,0 +1,197 @@
+#ifndef DISTRIBUTED_SYNC_H
+#define DISTRIBUTED_SYNC_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include "thread_config.hpp"
+#include "frame_data.hpp"
+
+/*
+*    Synchronization of streams which are decoded by several ingest processes
+*
+*    Every ingest worker opens two TCP connections to the coordinator. On the
+*    metadata connection the worker publishes the metadata (stream, sequence
+*    number, status, frame type and timestamp) of every frame it decodes and
+*    the coordinator replies with the frames it matched into a frame packet.
+*    The worker keeps matched frames for a while and releases all others. On
+*    the fetch connection the coordinator requests the data of matched frames
+*    once a consumer needs them, so frames only cross process boundaries on
+*    demand.
+*
+*    metadata connection:  worker -> DSyncHello, DSyncMetadata...
+*                          coordinator -> DSyncFrameRef... (matched frames)
+*    fetch connection:     worker -> DSyncHello
+*                          coordinator -> DSyncFetchRequest, DSyncFrameRef x num_frames
+*                          worker -> [DSyncFrameHeader, frame, motion vectors] x num_frames
+*
+*    Global stream ids (cap_id on the coordinator) enumerate the streams of
+*    worker 0 first, then those of worker 1 and so on. Structs are sent in host
+*    byte order, so all processes have to run on the same architecture.
+*
+*/
+
+#define DSYNC_MAGIC  0x434e5953  // "SYNC"
+#define DSYNC_CHANNEL_METADATA  0
+#define DSYNC_CHANNEL_FETCH  1
+#define DSYNC_MAX_FRAME_DIMENSION  16384  // larger frame headers are treated as protocol errors
+
+struct DSyncHello {
+    uint32_t magic;
+    uint32_t channel;
+    uint32_t worker_id;
+    uint32_t num_streams;
+};
+
+struct DSyncMetadata {
+    uint32_t stream;  // index of the stream within the worker
+    int32_t frame_status;  // CAP_BROKEN once the stream is lost
+    uint64_t sequence;
+    double timestamp;
+    char frame_type[2];
+    char reserved[6];
+};
+
+struct DSyncFrameRef {
+    uint32_t stream;
+    uint32_t reserved;
+    uint64_t sequence;
+};
+
+struct DSyncFetchRequest {
+    uint32_t num_frames;
+    uint32_t reserved;
+};
+
+struct DSyncFrameHeader {
+    int32_t frame_status;  // FRAME_DROPPED if the worker released the frame already
+    int32_t height;
+    int32_t width;
+    char frame_type[2];
+    char reserved[2];
+    double timestamp;
+    int64_t num_mvs;
+};
+
+
+/*
+*    Worker side: publishes frame metadata and serves frame data to the coordinator
+*
+*/
+
+class IngestPublisher {
+
+private:
+
+    struct StreamFrames {
+        uint64_t next_sequence = 1;
+        std::deque<std::shared_ptr<FrameData> > pending;  // published, not yet matched
+        std::deque<std::shared_ptr<FrameData> > matched;  // matched, kept for fetching
+    };
+
+    int metadata_fd;
+    int fetch_fd;
+    std::size_t max_pending_frames;
+    std::size_t max_matched_frames;
+    std::vector<StreamFrames> streams;
+    bool connected;
+    std::mutex mutex_;  // protects streams, connected and writes to metadata_fd
+
+    ThreadConfig thread_config;
+    std::thread match_thread;
+    std::thread fetch_thread;
+
+    /* sends a metadata record (called with mutex_ held) */
+    void send_metadata(const DSyncMetadata& metadata);
+
+    /* background thread which receives the frames matched by the coordinator */
+    void receive_matches(void);
+
+    /* background thread which answers fetch requests of the coordinator */
+    void serve_fetches(void);
+
+public:
+
+    /* connects to the coordinator at "host:port", retrying for connect_timeout
+    seconds, throws StreamProcessingError on failure. Per stream at most
+    max_pending_frames unmatched and max_matched_frames matched frames are kept. */
+    IngestPublisher(const std::string& address, int worker_id, std::size_t num_streams,
+        std::size_t max_pending_frames = 64, std::size_t max_matched_frames = 32,
+        double connect_timeout = 30, const ThreadConfig& thread_config = ThreadConfig());
+
+    /* closes the connections and joins the threads */
+    ~IngestPublisher();
+
+    /* assigns the next sequence number of the stream to the frame and publishes its metadata */
+    void publish(std::size_t stream, const std::shared_ptr<FrameData>& frame_data);
+
+    /* tells the coordinator that the stream delivers no more frames */
+    void publish_broken(std::size_t stream);
+};
+
+
+/*
+*    Coordinator side: collects frame metadata of all workers and fetches frame data
+*
+*/
+
+typedef std::function<void(std::shared_ptr<FrameData>)> DSyncMetadataCallback;
+
+class CoordinatorServer {
+
+private:
+
+    struct Worker {
+        int metadata_fd = -1;
+        int fetch_fd = -1;
+        std::size_t num_streams = 0;
+        std::size_t first_cap_id = 0;
+        std::mutex send_mutex;  // serializes writes to metadata_fd
+        std::mutex fetch_mutex;  // one fetch at a time on fetch_fd
+        std::atomic<bool> lost{false};  // set once a connection of the worker failed
+    };
+
+    std::vector<std::unique_ptr<Worker> > workers;  // indexed by worker id
+    std::vector<std::size_t> stream_workers;  // worker of every cap_id
+    std::unique_ptr<std::atomic<bool>[]> stream_valid;
+    std::vector<std::thread> threads;
+
+    /* background thread which receives the metadata published by a worker */
+    void receive_metadata(std::size_t worker_id, DSyncMetadataCallback callback, ThreadConfig thread_config);
+
+public:
+
+    /* listens on port and blocks until all num_workers workers connected,
+    throws StreamProcessingError on failure */
+    CoordinatorServer(int port, std::size_t num_workers);
+
+    /* closes the connections and joins the threads */
+    ~CoordinatorServer();
+
+    /* total number of streams of all workers */
+    std::size_t num_streams(void) const;
+
+    /* false once the stream or its worker is lost */
+    bool stream_is_valid(std::size_t cap_id) const;
+
+    /* starts receiving metadata, the callback is invoked with a FrameData
+    without frame buffers for every frame (status CAP_BROKEN for lost streams) */
+    void start(DSyncMetadataCallback callback, const ThreadConfig& thread_config);
+
+    /* tells the workers which frames belong to the frame packet */
+    void send_matches(const SSFramePacket& frame_packet);
+
+    /* fetches the frame data of all valid frames of the packet from the workers,
+    other frames are passed through. If a fetch fails, the worker is marked as
+    lost (its streams become CAP_BROKEN) and its frames get status CAP_BROKEN. */
+    void fetch(const SSFramePacket& frame_packet, SSFramePacket& fetched);
+};
+
+#endif
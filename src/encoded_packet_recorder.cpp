@@ -0,0 +1,303 @@
+#include "encoded_packet_recorder.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/parseutils.h>
+}
+
+
+// lets blocking demuxer calls return once the recorder is stopped
+static int interrupt_callback(void *opaque) {
+    return static_cast<std::atomic<bool>*>(opaque)->load() ? 1 : 0;
+}
+
+
+static std::string av_error_string(int errnum) {
+    char buffer[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(errnum, buffer, sizeof(buffer));
+    return std::string(buffer);
+}
+
+
+EncodedPacketRecorder::EncodedPacketRecorder(const std::string& source, double max_duration, std::size_t max_bytes,
+    const ThreadConfig& thread_config, const std::string& thread_name) {
+
+    this->source = source;
+    this->max_duration = max_duration;
+    this->max_bytes = max_bytes;
+    this->thread_config = thread_config;
+    this->thread_name = thread_name;
+    this->total_bytes = 0;
+    this->has_start_timestamp = false;
+    this->fmt_ctx = NULL;
+    this->codecpar = NULL;
+    this->stop = false;
+
+    const char *protocol = avio_find_protocol_name(source.c_str());
+    this->is_file = (protocol != NULL) && (strcmp(protocol, "file") == 0);
+
+    std::string error;
+    if(!this->open(error)) {
+        avcodec_parameters_free(&this->codecpar);
+        throw StreamProcessingError(error);
+    }
+
+    this->thread = std::thread(&EncodedPacketRecorder::capture, this);
+}
+
+
+EncodedPacketRecorder::~EncodedPacketRecorder() {
+    this->stop = true;
+    if(this->thread.joinable())
+        this->thread.join();
+
+    for(std::size_t i = 0; i < this->ring.size(); i++) {
+        av_packet_free(&this->ring[i].packet);
+    }
+    avformat_close_input(&this->fmt_ctx);
+    avcodec_parameters_free(&this->codecpar);
+}
+
+
+bool EncodedPacketRecorder::open(std::string& error) {
+    this->fmt_ctx = avformat_alloc_context();
+    this->fmt_ctx->interrupt_callback.callback = interrupt_callback;
+    this->fmt_ctx->interrupt_callback.opaque = &this->stop;
+
+    AVDictionary *opts = NULL;
+    av_dict_set(&opts, "rtsp_transport", "tcp", 0);
+
+    // frees the context and sets it to NULL on failure
+    int ret = avformat_open_input(&this->fmt_ctx, this->source.c_str(), NULL, &opts);
+    av_dict_free(&opts);
+    if(ret < 0) {
+        error = "Could not open " + this->source + " for packet recording: " + av_error_string(ret);
+        return false;
+    }
+
+    ret = avformat_find_stream_info(this->fmt_ctx, NULL);
+    if(ret >= 0)
+        ret = av_find_best_stream(this->fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if(ret < 0) {
+        avformat_close_input(&this->fmt_ctx);
+        error = "Could not find a video stream in " + this->source + ": " + av_error_string(ret);
+        return false;
+    }
+    this->stream_idx = ret;
+    AVStream *stream = this->fmt_ctx->streams[this->stream_idx];
+
+    this->has_start_timestamp = false;
+    if(this->fmt_ctx->start_time_realtime != AV_NOPTS_VALUE && this->fmt_ctx->start_time_realtime > 0) {
+        // RTSP demuxer sets the wall time of pts = 0 from the first RTCP sender report
+        this->start_timestamp = this->fmt_ctx->start_time_realtime / 1000000.0;
+        this->has_start_timestamp = true;
+    }
+    else if(this->is_file) {
+        // files carry no wall time, use their own time starting at the creation time if tagged
+        this->start_timestamp = 0;
+        AVDictionaryEntry *creation_time = av_dict_get(this->fmt_ctx->metadata, "creation_time", NULL, 0);
+        int64_t creation_us = 0;
+        if(creation_time && av_parse_time(&creation_us, creation_time->value, 0) == 0)
+            this->start_timestamp = creation_us / 1000000.0;
+        if(stream->start_time != AV_NOPTS_VALUE)
+            this->start_timestamp -= stream->start_time * av_q2d(stream->time_base);
+        this->has_start_timestamp = true;
+    }
+
+    // packets of a previous connection can not be muxed together with the new ones
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    for(std::size_t i = 0; i < this->ring.size(); i++) {
+        av_packet_free(&this->ring[i].packet);
+    }
+    this->ring.clear();
+    this->total_bytes = 0;
+
+    if(!this->codecpar)
+        this->codecpar = avcodec_parameters_alloc();
+    avcodec_parameters_copy(this->codecpar, stream->codecpar);
+    this->time_base = stream->time_base;
+    return true;
+}
+
+
+void EncodedPacketRecorder::evict(void) {
+    while(!this->ring.empty()) {
+        bool too_long = (this->max_duration > 0) &&
+            (this->ring.back().timestamp - this->ring.front().timestamp > this->max_duration);
+        bool too_large = (this->max_bytes > 0) && (this->total_bytes > this->max_bytes);
+        if(!too_long && !too_large)
+            break;
+
+        this->total_bytes -= this->ring.front().packet->size;
+        av_packet_free(&this->ring.front().packet);
+        this->ring.pop_front();
+    }
+}
+
+
+void EncodedPacketRecorder::capture(void) {
+
+    apply_thread_config(this->thread_config, this->thread_name);
+
+    AVPacket *packet = av_packet_alloc();
+    int open_errors = 0;
+
+    while(!this->stop) {
+        // reopen a broken connection once per second, report only the first failure of a series
+        if(!this->fmt_ctx) {
+            for(int i = 0; i < 10 && !this->stop; i++)
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            std::string error;
+            if(!this->open(error)) {
+                if(open_errors++ == 0 && !this->stop)
+                    std::cerr << error << ", retrying" << std::endl;
+                continue;
+            }
+            std::cerr << "Packet recorder reconnected to " << this->source << std::endl;
+            open_errors = 0;
+        }
+
+        int ret = av_read_frame(this->fmt_ctx, packet);
+        if(ret == AVERROR(EAGAIN))
+            continue;
+        if(ret < 0) {
+            if(this->stop)
+                break;
+            if(this->is_file) {
+                if(ret != AVERROR_EOF)
+                    std::cerr << "Packet recorder stopped reading from " << this->source
+                              << ": " << av_error_string(ret) << std::endl;
+                break;
+            }
+            std::cerr << "Packet recorder could not read from " << this->source
+                      << ": " << av_error_string(ret) << ", reconnecting" << std::endl;
+            avformat_close_input(&this->fmt_ctx);
+            continue;
+        }
+
+        if(packet->stream_index != this->stream_idx) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        int64_t pts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+        if(pts == AV_NOPTS_VALUE) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        // without sender wall time (e.g. before the first RTCP sender report) anchor the first packet at the system time
+        double time_base = av_q2d(this->fmt_ctx->streams[this->stream_idx]->time_base);
+        if(!this->has_start_timestamp) {
+            auto now = std::chrono::system_clock::now().time_since_epoch();
+            this->start_timestamp = std::chrono::duration<double>(now).count() - pts * time_base;
+            this->has_start_timestamp = true;
+        }
+
+        EncodedPacket encoded_packet;
+        encoded_packet.timestamp = this->start_timestamp + pts * time_base;
+        encoded_packet.keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+        encoded_packet.packet = av_packet_alloc();
+        av_packet_move_ref(encoded_packet.packet, packet);
+
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->total_bytes += encoded_packet.packet->size;
+        this->ring.push_back(encoded_packet);
+        this->evict();
+    }
+
+    av_packet_free(&packet);
+}
+
+
+bool EncodedPacketRecorder::export_clip(double timestamp0, double timestamp1, const std::string& path, double& clip_timestamp) {
+
+    // reference the required packets, muxing happens without holding the lock
+    std::vector<AVPacket*> packets;
+    AVCodecParameters *codecpar = NULL;
+    AVRational time_base;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+
+        std::size_t start = this->ring.size();
+        for(std::size_t i = 0; i < this->ring.size() && this->ring[i].timestamp <= timestamp1; i++) {
+            if(!this->ring[i].keyframe)
+                continue;
+            // last keyframe at or before timestamp0, otherwise first keyframe after it
+            if(this->ring[i].timestamp <= timestamp0 || start == this->ring.size())
+                start = i;
+            if(this->ring[i].timestamp > timestamp0)
+                break;
+        }
+
+        for(std::size_t i = start; i < this->ring.size() && this->ring[i].timestamp <= timestamp1; i++) {
+            packets.push_back(av_packet_clone(this->ring[i].packet));
+        }
+
+        if(packets.empty())
+            return false;
+
+        clip_timestamp = this->ring[start].timestamp;
+        codecpar = avcodec_parameters_alloc();
+        avcodec_parameters_copy(codecpar, this->codecpar);
+        time_base = this->time_base;
+    }
+
+    AVFormatContext *out_ctx = NULL;
+    std::stringstream error;
+
+    int ret = avformat_alloc_output_context2(&out_ctx, NULL, "mp4", path.c_str());
+    AVStream *out_stream = (ret >= 0) ? avformat_new_stream(out_ctx, NULL) : NULL;
+    if(out_stream) {
+        ret = avcodec_parameters_copy(out_stream->codecpar, codecpar);
+        out_stream->codecpar->codec_tag = 0;
+        out_stream->time_base = time_base;
+    }
+    if(ret >= 0 && out_stream)
+        ret = avio_open(&out_ctx->pb, path.c_str(), AVIO_FLAG_WRITE);
+    if(ret >= 0 && out_stream)
+        ret = avformat_write_header(out_ctx, NULL);
+
+    if(ret < 0 || !out_stream) {
+        error << "Could not create clip " << path << ": " << av_error_string(ret);
+    }
+    else {
+        // shift timestamps so that the clip starts at zero
+        int64_t offset = (packets[0]->dts != AV_NOPTS_VALUE) ? packets[0]->dts : packets[0]->pts;
+        for(std::size_t i = 0; i < packets.size() && ret >= 0; i++) {
+            AVPacket *packet = packets[i];
+            if(packet->pts != AV_NOPTS_VALUE)
+                packet->pts -= offset;
+            if(packet->dts != AV_NOPTS_VALUE)
+                packet->dts -= offset;
+            packet->stream_index = 0;
+            packet->pos = -1;
+            av_packet_rescale_ts(packet, time_base, out_stream->time_base);
+            ret = av_interleaved_write_frame(out_ctx, packet);
+        }
+        if(ret >= 0)
+            ret = av_write_trailer(out_ctx);
+        if(ret < 0)
+            error << "Could not write clip " << path << ": " << av_error_string(ret);
+    }
+
+    for(std::size_t i = 0; i < packets.size(); i++) {
+        av_packet_free(&packets[i]);
+    }
+    avcodec_parameters_free(&codecpar);
+    if(out_ctx) {
+        if(out_ctx->pb)
+            avio_closep(&out_ctx->pb);
+        avformat_free_context(out_ctx);
+    }
+
+    if(!error.str().empty())
+        throw StreamProcessingError(error.str());
+
+    return true;
+}
@@ -0,0 +1,101 @@
+#ifndef ENCODED_PACKET_RECORDER_H
+#define ENCODED_PACKET_RECORDER_H
+
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "exceptions.hpp"
+#include "thread_config.hpp"
+
+/*
+*    Encoded (H.264) packet of a stream with its estimated UNIX timestamp
+*
+*/
+
+struct EncodedPacket {
+    AVPacket *packet;
+    double timestamp;
+    bool keyframe;
+};
+
+
+/*
+*    Keeps a ring of the most recent encoded packets of a stream
+*
+*    VideoCap decodes internally and does not expose the demuxed packets, so
+*    the recorder opens its own demux-only connection to the same source and
+*    runs it in a background thread. Packets are never decoded. Timestamps are
+*    derived from the sender wall time provided by the demuxer (RTCP sender
+*    reports for RTSP) and thus match the frame timestamps of VideoCap closely.
+*    Video files are stamped with their own time instead, i.e. the seconds
+*    since the start of the file plus its creation_time tag if present.
+*
+*    After a read error the connection is reopened until it succeeds. The
+*    packets of the previous connection are released, as their timestamps can
+*    not be muxed together with those of the new one. Files are read once.
+*
+*    The ring allows to export the packets of a time range as MP4 by remuxing
+*    without re-encoding. Exported clips start at the keyframe preceding the
+*    requested start time, so they are always decodable.
+*
+*/
+
+class EncodedPacketRecorder {
+
+private:
+
+    std::string source;
+    double max_duration;  // in seconds
+    std::size_t max_bytes;
+
+    bool is_file;
+    AVFormatContext *fmt_ctx;  // used by the capture thread only, once it started
+    int stream_idx;
+    double start_timestamp;  // UNIX timestamp (file time for files) of pts = 0
+    bool has_start_timestamp;
+
+    std::deque<EncodedPacket> ring;
+    std::size_t total_bytes;
+    AVCodecParameters *codecpar;  // of the current connection, for muxing
+    AVRational time_base;
+    std::mutex mutex_;  // protects ring, total_bytes, codecpar and time_base
+
+    std::thread thread;
+    ThreadConfig thread_config;
+    std::string thread_name;
+    std::atomic<bool> stop;
+
+    /* opens the source and finds its video stream, returns false with a message on failure */
+    bool open(std::string& error);
+
+    /* background thread which reads packets from the stream into the ring */
+    void capture(void);
+
+    /* removes the oldest packets until the limits are met (called with mutex_ held) */
+    void evict(void);
+
+public:
+
+    /* opens the source and starts capturing on a thread with the given name and
+    placement, throws StreamProcessingError on failure */
+    EncodedPacketRecorder(const std::string& source, double max_duration, std::size_t max_bytes,
+        const ThreadConfig& thread_config = ThreadConfig(), const std::string& thread_name = "ss_pktring");
+
+    /* stops capturing and releases all packets */
+    ~EncodedPacketRecorder();
+
+    /* writes all packets from the keyframe preceding timestamp0 up to timestamp1
+    into an MP4 file and sets clip_timestamp to the timestamp of its first packet,
+    returns false if the ring holds no packets for this range */
+    bool export_clip(double timestamp0, double timestamp1, const std::string& path, double& clip_timestamp);
+};
+
+#endif
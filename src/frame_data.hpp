@@ -0,0 +1,59 @@
+#ifndef FRAME_DATA_H
+#define FRAME_DATA_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+
+#include "../../video_cap/src/video_cap_validator.hpp"
+
+/*
+*    Combines video frame, motion vectors, timestamp and other data read from the streams
+*
+*/
+
+#define FRAME_OKAY  0
+#define FRAME_DROPPED  1
+#define FRAME_READ_ERROR  2
+#define CAP_BROKEN  3
+#define FRAME_UNCHANGED  4  // below the motion gate threshold, frame buffers are not handed over
+
+struct PacketTensor;
+struct PacketMosaic;
+
+struct FrameData {
+    double timestamp;
+    uint8_t *frame = NULL;  // malloc'ed, owned by this object
+    int height;
+    int width;
+    MVS_DTYPE *motion_vectors = NULL;  // malloc'ed, owned by this object
+    MVS_DTYPE num_mvs;
+    char frame_type[2];
+    int frame_status;
+    float *compact_motion_vectors = NULL;  // optional (num_mvs x 4), malloc'ed, owned by this object
+    float *motion_grid = NULL;  // optional (grid_height x grid_width x 2), malloc'ed, owned by this object
+    int grid_height = 0;
+    int grid_width = 0;
+    float motion_score = -1;  // computed if the motion gate is enabled, otherwise -1
+    std::shared_ptr<PacketTensor> tensor;  // optional preprocessed tensor of the whole packet, shared by its frames
+    std::shared_ptr<PacketMosaic> mosaic;  // optional mosaic of the whole packet, shared by its frames
+    int cap_id = -1;  // stream the frame was read from, -1 for frames not read from a stream
+    uint64_t sequence = 0;  // number of the frame within its stream if published by an ingest worker, otherwise 0
+
+    FrameData() = default;
+    FrameData(const FrameData&) = delete;
+    FrameData& operator=(const FrameData&) = delete;
+
+    // buffers are released once the last shared_ptr to the frame data is gone
+    ~FrameData() {
+        free(this->frame);
+        free(this->motion_vectors);
+        free(this->compact_motion_vectors);
+        free(this->motion_grid);
+    }
+};
+
+typedef std::vector<std::shared_ptr<FrameData> > SSFramePacket;
+
+#endif
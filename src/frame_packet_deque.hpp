@@ -2,6 +2,9 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 
 /** Thread-safe ring buffer for SSFramePacket
@@ -12,7 +15,14 @@
 *  new frame_packet in the back of the deque. If maxsize is specified the deque
 *  grows until this size is reached. Further calls to push() will remove the
 *  oldest frame_packet from the deque and only then insert the new frame_packet,
-*  keeping the size of the deque constant.
+*  keeping the size of the deque constant. push_wait() instead blocks until
+*  pop() made room for the new frame_packet, so that no frame_packet is lost.
+*  The number of frame_packets dropped by push() and the total time push_wait()
+*  was blocked by a slow consumer are counted.
+*
+*  The deque also maintains an eventfd whose counter equals the number of
+*  frame_packets in the deque. It is readable as long as the deque is not empty
+*  and can be registered with select/poll/epoll or an asyncio event loop.
 *
 *   @param maxsize If <= 0 (default) do not limit the size of the deque. If > 0
 *       allow the deque to reach at most this size.
@@ -21,6 +31,16 @@ class FramePacketDeque {
 public:
     FramePacketDeque(std::size_t maxsize=-1) {
         this->maxsize = maxsize;
+        this->dropped = 0;
+        this->blocked_time = 0;
+        this->event_fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE | EFD_CLOEXEC);
+        if (this->event_fd < 0) {
+            throw StreamProcessingError("Could not create eventfd for the frame packet buffer.");
+        }
+    }
+
+    ~FramePacketDeque() {
+        close(this->event_fd);
     }
 
     SSFramePacket pop() {
@@ -31,6 +51,9 @@ public:
         }
         SSFramePacket frame_packet = this->deque_.front();
         this->deque_.pop_front();
+        this->consume_event();
+        mlock.unlock();
+        this->not_full_.notify_one();
         return frame_packet;
     }
 
@@ -42,19 +65,33 @@ public:
         }
         frame_packet = this->deque_.front();
         this->deque_.pop_front();
+        this->consume_event();
+        mlock.unlock();
+        this->not_full_.notify_one();
+    }
+
+    bool try_pop(SSFramePacket& frame_packet) {
+        std::unique_lock<std::mutex> mlock(this->mutex_);
+        if (this->deque_.empty()) {
+            return false;
+        }
+        frame_packet = this->deque_.front();
+        this->deque_.pop_front();
+        this->consume_event();
+        mlock.unlock();
+        this->not_full_.notify_one();
+        return true;
     }
 
     void push(const SSFramePacket& frame_packet) {
         std::unique_lock<std::mutex> mlock(this->mutex_);
         if (this->maxsize > 0 && (this->deque_.size() == this->maxsize)) { // deque is full
-            SSFramePacket frame_packet = this->deque_.front();
-            for (std::size_t cap_id = 0; cap_id < frame_packet.size(); cap_id++) {
-                free((*frame_packet[cap_id]).frame);
-                free((*frame_packet[cap_id]).motion_vectors);
-            }
-            this->deque_.pop_front();
+            this->deque_.pop_front();  // frame data is freed once no other reference exists
+            this->consume_event();
+            this->dropped++;
         }
         this->deque_.push_back(frame_packet);
+        this->signal_event();
         mlock.unlock();
         this->cond_.notify_one();
     }
@@ -62,14 +99,27 @@ public:
     void push(SSFramePacket&& frame_packet) {
         std::unique_lock<std::mutex> mlock(this->mutex_);
         if (this->maxsize > 0 && (this->deque_.size() == this->maxsize)) { // deque is full
-            SSFramePacket frame_packet = this->deque_.front();
-            for (std::size_t cap_id = 0; cap_id < frame_packet.size(); cap_id++) {
-                free((*frame_packet[cap_id]).frame);
-                free((*frame_packet[cap_id]).motion_vectors);
+            this->deque_.pop_front();  // frame data is freed once no other reference exists
+            this->consume_event();
+            this->dropped++;
+        }
+        this->deque_.push_back(std::move(frame_packet));
+        this->signal_event();
+        mlock.unlock();
+        this->cond_.notify_one();
+    }
+
+    void push_wait(SSFramePacket&& frame_packet) {
+        std::unique_lock<std::mutex> mlock(this->mutex_);
+        if (this->maxsize > 0 && this->deque_.size() >= this->maxsize) { // deque is full
+            auto start = std::chrono::steady_clock::now();
+            while (this->deque_.size() >= this->maxsize) {
+                this->not_full_.wait(mlock);
             }
-            this->deque_.pop_front();
+            this->blocked_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
         }
         this->deque_.push_back(std::move(frame_packet));
+        this->signal_event();
         mlock.unlock();
         this->cond_.notify_one();
     }
@@ -82,9 +132,42 @@ public:
       return size;
     }
 
+    int fd(void) {
+      return this->event_fd;
+    }
+
+    // number of frame_packets removed by push() because the deque was full
+    uint64_t num_dropped(void) {
+      std::unique_lock<std::mutex> mlock(mutex_);
+      return this->dropped;
+    }
+
+    // total time in seconds push_wait() waited for the consumer
+    double time_blocked(void) {
+      std::unique_lock<std::mutex> mlock(mutex_);
+      return this->blocked_time;
+    }
+
 private:
+    // keep the eventfd counter equal to the deque size (called with mutex_ held)
+    void signal_event(void) {
+        uint64_t one = 1;
+        ssize_t ret = write(this->event_fd, &one, sizeof(one));
+        (void)ret;
+    }
+
+    void consume_event(void) {
+        uint64_t value;
+        ssize_t ret = read(this->event_fd, &value, sizeof(value));
+        (void)ret;
+    }
+
     std::size_t maxsize;
+    uint64_t dropped;
+    double blocked_time;
+    int event_fd;
     std::deque<SSFramePacket> deque_;
     std::mutex mutex_;
     std::condition_variable cond_;
+    std::condition_variable not_full_;
 };
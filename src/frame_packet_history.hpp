@@ -0,0 +1,131 @@
+#include <deque>
+#include <mutex>
+#include <algorithm>
+
+
+/** Bounded, timestamp-indexed history of recent SSFramePackets
+*
+*  Keeps the most recently generated frame_packets sorted by their packet
+*  timestamp (the query timestamp used for synchronization) so that they can be
+*  looked up later, e.g. to retrieve the frames from a few seconds before an
+*  event. Frame data is shared with the live output via reference counting, so
+*  no frames are copied. Once one of the limits is exceeded the oldest
+*  frame_packets are removed.
+*
+*  Lookups use binary search and hold the lock only for the search and copying
+*  the shared pointers of the result, so they do not stall packet generation.
+*
+*   @param max_packets Maximum number of frame_packets kept. If 0, the number is
+*       not limited.
+*   @param max_bytes Maximum total size of frames and motion vectors kept. If 0,
+*       the size is not limited.
+*/
+class FramePacketHistory {
+public:
+    FramePacketHistory(std::size_t max_packets, std::size_t max_bytes) {
+        this->max_packets = max_packets;
+        this->max_bytes = max_bytes;
+        this->total_bytes = 0;
+    }
+
+    void push(double timestamp, const SSFramePacket& frame_packet) {
+        Entry entry;
+        entry.timestamp = timestamp;
+        entry.frame_packet = frame_packet;
+        entry.bytes = packet_bytes(frame_packet);
+        std::size_t bytes = entry.bytes;
+
+        std::unique_lock<std::mutex> mlock(this->mutex_);
+        // packet timestamps are monotonic in general, only search if not
+        if (this->history_.empty() || this->history_.back().timestamp <= timestamp) {
+            this->history_.push_back(std::move(entry));
+        }
+        else {
+            auto it = std::upper_bound(this->history_.begin(), this->history_.end(), timestamp,
+                [](double t, const Entry& e) { return t < e.timestamp; });
+            this->history_.insert(it, std::move(entry));
+        }
+        this->total_bytes += bytes;
+
+        while (!this->history_.empty() &&
+              ((this->max_packets > 0 && this->history_.size() > this->max_packets) ||
+               (this->max_bytes > 0 && this->total_bytes > this->max_bytes))) {
+            this->total_bytes -= this->history_.front().bytes;
+            this->history_.pop_front();
+        }
+    }
+
+    // retrieves the frame_packet whose timestamp is closest to timestamp
+    bool get_packet_at(double timestamp, SSFramePacket& frame_packet, double& packet_timestamp) {
+        std::unique_lock<std::mutex> mlock(this->mutex_);
+        if (this->history_.empty()) {
+            return false;
+        }
+        auto it = this->lower_bound(timestamp);
+        if (it == this->history_.end() ||
+           (it != this->history_.begin() && (timestamp - (it - 1)->timestamp) < (it->timestamp - timestamp))) {
+            --it;
+        }
+        frame_packet = it->frame_packet;
+        packet_timestamp = it->timestamp;
+        return true;
+    }
+
+    // retrieves all frame_packets with timestamp0 <= timestamp <= timestamp1 in chronological order
+    void get_packets_between(double timestamp0, double timestamp1,
+        std::vector<SSFramePacket>& frame_packets, std::vector<double>& packet_timestamps) {
+        std::unique_lock<std::mutex> mlock(this->mutex_);
+        frame_packets.clear();
+        packet_timestamps.clear();
+        for (auto it = this->lower_bound(timestamp0); it != this->history_.end() && it->timestamp <= timestamp1; ++it) {
+            frame_packets.push_back(it->frame_packet);
+            packet_timestamps.push_back(it->timestamp);
+        }
+    }
+
+    std::size_t size(void) {
+      std::unique_lock<std::mutex> mlock(this->mutex_);
+      return this->history_.size();
+    }
+
+    std::size_t bytes(void) {
+      std::unique_lock<std::mutex> mlock(this->mutex_);
+      return this->total_bytes;
+    }
+
+private:
+    struct Entry {
+        double timestamp;
+        SSFramePacket frame_packet;
+        std::size_t bytes;
+    };
+
+    static std::size_t packet_bytes(const SSFramePacket& frame_packet) {
+        std::size_t bytes = 0;
+        for (std::size_t cap_id = 0; cap_id < frame_packet.size(); cap_id++) {
+            if (frame_packet[cap_id]->frame_status != FRAME_OKAY) {
+                continue;
+            }
+            bytes += (std::size_t)frame_packet[cap_id]->width * frame_packet[cap_id]->height * 3;
+            bytes += (std::size_t)frame_packet[cap_id]->num_mvs * 10 * sizeof(MVS_DTYPE);
+            if (frame_packet[cap_id]->compact_motion_vectors) {
+                bytes += (std::size_t)frame_packet[cap_id]->num_mvs * MVS_COMPACT_COLUMNS * sizeof(float);
+            }
+            if (frame_packet[cap_id]->motion_grid) {
+                bytes += (std::size_t)frame_packet[cap_id]->grid_height * frame_packet[cap_id]->grid_width * 2 * sizeof(float);
+            }
+        }
+        return bytes;
+    }
+
+    std::deque<Entry>::iterator lower_bound(double timestamp) {
+        return std::lower_bound(this->history_.begin(), this->history_.end(), timestamp,
+            [](const Entry& e, double t) { return e.timestamp < t; });
+    }
+
+    std::size_t max_packets;
+    std::size_t max_bytes;
+    std::size_t total_bytes;
+    std::deque<Entry> history_;
+    std::mutex mutex_;
+};
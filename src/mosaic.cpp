@@ -0,0 +1,173 @@
+#include "mosaic.hpp"
+
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+#include "exceptions.hpp"
+
+
+#define MOSAIC_POOL_SIZE  4  // buffers kept for reuse
+
+
+PacketMosaic::~PacketMosaic() {
+    if(this->pool)
+        this->pool->release(this->data);
+    else
+        free(this->data);
+}
+
+
+MosaicBufferPool::MosaicBufferPool(std::size_t buffer_size) {
+    this->buffer_size = buffer_size;
+}
+
+
+MosaicBufferPool::~MosaicBufferPool() {
+    for(std::size_t i = 0; i < this->buffers.size(); i++) {
+        free(this->buffers[i]);
+    }
+}
+
+
+uint8_t* MosaicBufferPool::acquire(void) {
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+    if(!this->buffers.empty()) {
+        uint8_t *buffer = this->buffers.back();
+        this->buffers.pop_back();
+        return buffer;
+    }
+    mlock.unlock();
+
+    uint8_t *buffer = (uint8_t*)malloc(this->buffer_size);
+    if(!buffer)
+        throw StreamProcessingError("Could not allocate the mosaic buffer.");
+    return buffer;
+}
+
+
+void MosaicBufferPool::release(uint8_t *buffer) {
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+    if(this->buffers.size() < MOSAIC_POOL_SIZE) {
+        this->buffers.push_back(buffer);
+        return;
+    }
+    mlock.unlock();
+    free(buffer);
+}
+
+
+MosaicRenderer::MosaicRenderer(const MosaicConfig& config, std::size_t num_streams) {
+    this->config = config;
+
+    this->columns = config.columns;
+    if(this->columns <= 0)
+        this->columns = std::max((int)std::ceil(std::sqrt((double)num_streams)), 1);
+    this->rows = std::max(((int)num_streams + this->columns - 1) / this->columns, 1);
+
+    std::size_t buffer_size = (std::size_t)this->rows * config.tile_height * this->columns * config.tile_width * 3;
+    this->buffer_pool = std::make_shared<MosaicBufferPool>(buffer_size);
+
+    for(std::size_t i = 0; i < num_streams; i++) {
+        this->last_tiles.push_back(cv::Mat());
+    }
+}
+
+
+static const char* status_text(int frame_status) {
+    if(frame_status == FRAME_DROPPED)
+        return "FRAME DROPPED";
+    else if(frame_status == FRAME_READ_ERROR)
+        return "READ ERROR";
+    else if(frame_status == CAP_BROKEN)
+        return "CAP BROKEN";
+    else if(frame_status == FRAME_UNCHANGED)
+        return "UNCHANGED";
+    return "";
+}
+
+
+void MosaicRenderer::render_tile(const FrameData& frame_data, std::size_t cap_id, double packet_timestamp, cv::Mat& mosaic) {
+
+    int x = (int)(cap_id % this->columns) * this->config.tile_width;
+    int y = (int)(cap_id / this->columns) * this->config.tile_height;
+    cv::Mat tile = mosaic(cv::Rect(x, y, this->config.tile_width, this->config.tile_height));
+    cv::Mat& last_tile = this->last_tiles[cap_id];
+
+    bool has_image = false;
+    if(frame_data.frame_status == FRAME_OKAY) {
+        // resizing directly into the tile writes into the mosaic buffer
+        cv::Mat frame(frame_data.height, frame_data.width, CV_8UC3, frame_data.frame);
+        cv::resize(frame, tile, cv::Size(this->config.tile_width, this->config.tile_height), 0, 0, cv::INTER_AREA);
+        tile.copyTo(last_tile);
+        has_image = true;
+    }
+    else if(frame_data.frame_status == FRAME_UNCHANGED && !last_tile.empty()) {
+        last_tile.copyTo(tile);
+        has_image = true;
+    }
+    else {
+        tile.setTo(cv::Scalar(64, 64, 64));
+    }
+
+    if(!this->config.overlay && has_image)
+        return;
+
+    double font_scale = std::max(this->config.tile_height / 480.0, 0.3);
+    int thickness = std::max((int)std::round(font_scale * 2), 1);
+    int line_height = (int)std::round(30 * font_scale);
+
+    // camera id, frame time and skew relative to the packet timestamp
+    std::stringstream header;
+    header << "cam " << cap_id;
+    if(frame_data.frame_status == FRAME_OKAY || frame_data.frame_status == FRAME_UNCHANGED) {
+        time_t seconds = (time_t)frame_data.timestamp;
+        struct tm local_time;
+        localtime_r(&seconds, &local_time);
+        int millis = (int)((frame_data.timestamp - seconds) * 1000);
+        header << "  " << std::put_time(&local_time, "%H:%M:%S") << "." << std::setw(3) << std::setfill('0') << millis
+               << "  skew " << std::showpos << (int)std::round((frame_data.timestamp - packet_timestamp) * 1000) << " ms";
+    }
+    if(this->config.overlay) {
+        cv::rectangle(tile, cv::Rect(0, 0, this->config.tile_width, line_height + thickness * 2), cv::Scalar(0, 0, 0), -1);
+        cv::putText(tile, header.str(), cv::Point(4, line_height - thickness), cv::FONT_HERSHEY_SIMPLEX,
+            font_scale, cv::Scalar(255, 255, 255), thickness, cv::LINE_AA);
+    }
+
+    // status of placeholder and unchanged tiles
+    if(frame_data.frame_status != FRAME_OKAY) {
+        cv::putText(tile, status_text(frame_data.frame_status),
+            cv::Point(4 + line_height / 2, this->config.tile_height / 2 + line_height / 2), cv::FONT_HERSHEY_SIMPLEX,
+            font_scale * 1.5, cv::Scalar(0, 0, 255), thickness * 2, cv::LINE_AA);
+    }
+}
+
+
+std::shared_ptr<PacketMosaic> MosaicRenderer::render(const SSFramePacket& frame_packet, double packet_timestamp, WorkerPool& pool) {
+
+    std::shared_ptr<PacketMosaic> packet_mosaic = std::make_shared<PacketMosaic>();
+    (*packet_mosaic).height = this->rows * this->config.tile_height;
+    (*packet_mosaic).width = this->columns * this->config.tile_width;
+    (*packet_mosaic).data = this->buffer_pool->acquire();
+    (*packet_mosaic).pool = this->buffer_pool;
+
+    cv::Mat mosaic((*packet_mosaic).height, (*packet_mosaic).width, CV_8UC3, (*packet_mosaic).data);
+    std::size_t num_tiles = std::min(frame_packet.size(), this->last_tiles.size());
+
+    // one iteration per tile, tiles never overlap
+    pool.parallel_for((std::size_t)this->rows * this->columns, [&](std::size_t tile_id) {
+        if(tile_id < num_tiles) {
+            this->render_tile(*frame_packet[tile_id], tile_id, packet_timestamp, mosaic);
+        }
+        else {
+            // recycled buffers contain old content in unused tiles
+            int x = (int)(tile_id % this->columns) * this->config.tile_width;
+            int y = (int)(tile_id / this->columns) * this->config.tile_height;
+            mosaic(cv::Rect(x, y, this->config.tile_width, this->config.tile_height)).setTo(cv::Scalar(0, 0, 0));
+        }
+    });
+
+    return packet_mosaic;
+}
@@ -0,0 +1,97 @@
+#ifndef MOSAIC_H
+#define MOSAIC_H
+
+#include <vector>
+#include <mutex>
+#include <memory>
+
+// OpenCV
+#include <opencv2/opencv.hpp>
+
+#include "frame_data.hpp"
+#include "worker_pool.hpp"
+
+/*
+*    Composition of the frames of a packet into one mosaic image for monitoring
+*
+*    Every frame is downscaled into its tile of a grid (row-major by cap_id)
+*    with OpenCV's SIMD optimized area interpolation. Tiles are rendered in
+*    parallel on the worker pool. Optionally, camera id, frame time and the
+*    skew of the frame relative to the packet timestamp are overlaid. Streams
+*    without a valid frame get a placeholder tile with their status, streams
+*    with FRAME_UNCHANGED repeat their last tile.
+*
+*    Mosaic buffers are taken from a small pool and return to it once the last
+*    reference to the mosaic is gone, so no memory is allocated per packet in
+*    steady state.
+*
+*/
+
+struct MosaicConfig {
+    int tile_width = 0;  // size of one tile, the mosaic is disabled if 0
+    int tile_height = 0;
+    int columns = 0;  // tiles per row, 0 for a square-ish grid
+    bool overlay = true;  // draw camera id, time, skew and status
+    std::size_t num_threads = 2;  // worker threads in addition to the synchronization thread
+};
+
+class MosaicBufferPool;
+
+struct PacketMosaic {
+    uint8_t *data = NULL;  // BGR image, owned by the buffer pool
+    int height;
+    int width;
+    std::shared_ptr<MosaicBufferPool> pool;
+
+    PacketMosaic() = default;
+    PacketMosaic(const PacketMosaic&) = delete;
+    PacketMosaic& operator=(const PacketMosaic&) = delete;
+
+    /* returns the buffer to the pool */
+    ~PacketMosaic();
+};
+
+class MosaicBufferPool {
+
+private:
+
+    std::size_t buffer_size;
+    std::vector<uint8_t*> buffers;
+    std::mutex mutex_;
+
+public:
+
+    MosaicBufferPool(std::size_t buffer_size);
+
+    ~MosaicBufferPool();
+
+    /* takes a buffer from the pool or allocates a new one */
+    uint8_t* acquire(void);
+
+    /* returns a buffer to the pool, surplus buffers are freed */
+    void release(uint8_t *buffer);
+};
+
+class MosaicRenderer {
+
+private:
+
+    MosaicConfig config;
+    int rows;
+    int columns;
+    std::shared_ptr<MosaicBufferPool> buffer_pool;
+    std::vector<cv::Mat> last_tiles;  // most recent tile of every stream, for unchanged frames
+
+    /* renders the tile of one stream into the mosaic */
+    void render_tile(const FrameData& frame_data, std::size_t cap_id, double packet_timestamp, cv::Mat& mosaic);
+
+public:
+
+    /* creates a renderer for packets of num_streams frames */
+    MosaicRenderer(const MosaicConfig& config, std::size_t num_streams);
+
+    /* renders the frame packet into a mosaic using the worker pool */
+    std::shared_ptr<PacketMosaic> render(const SSFramePacket& frame_packet, double packet_timestamp, WorkerPool& pool);
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "motion_vectors.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+
+MVS_DTYPE filter_zero_motion_vectors(MVS_DTYPE *motion_vectors, MVS_DTYPE num_mvs) {
+
+    // branchless stream compaction: every row is copied to the write position,
+    // which only advances for rows with motion
+    MVS_DTYPE num_kept = 0;
+    for(MVS_DTYPE i = 0; i < num_mvs; i++) {
+        const MVS_DTYPE *src = motion_vectors + i * 10;
+        MVS_DTYPE *dst = motion_vectors + num_kept * 10;
+        MVS_DTYPE keep = (src[7] | src[8]) != 0;
+        // dst is either src or an earlier row, so the rows never overlap partially
+        for(int k = 0; k < 10; k++) {
+            dst[k] = src[k];
+        }
+        num_kept += keep;
+    }
+    return num_kept;
+}
+
+
+void compact_motion_vectors(const MVS_DTYPE *motion_vectors, MVS_DTYPE num_mvs, float *compact) {
+    for(MVS_DTYPE i = 0; i < num_mvs; i++) {
+        const MVS_DTYPE *mv = motion_vectors + i * 10;
+        // motion_scale is never 0 for decoded vectors, guard against corrupt input anyway
+        float scale = 1.0f / (float)std::max((int32_t)mv[9], 1);
+        compact[i * 4 + 0] = (float)(int32_t)mv[5];
+        compact[i * 4 + 1] = (float)(int32_t)mv[6];
+        compact[i * 4 + 2] = (float)(int32_t)mv[7] * scale;
+        compact[i * 4 + 3] = (float)(int32_t)mv[8] * scale;
+    }
+}
+
+
+float motion_score(const MVS_DTYPE *motion_vectors, MVS_DTYPE num_mvs, int height, int width) {
+    float sum = 0.0f;
+    for(MVS_DTYPE i = 0; i < num_mvs; i++) {
+        const MVS_DTYPE *mv = motion_vectors + i * 10;
+        int32_t area = (int32_t)mv[1] * (int32_t)mv[2];
+        int32_t motion = std::abs((int32_t)mv[7]) + std::abs((int32_t)mv[8]);
+        sum += (float)(area * motion) / (float)std::max((int32_t)mv[9], 1);
+    }
+    return sum / (float)std::max(height * width, 1);
+}
+
+
+void motion_grid_size(int height, int width, int& grid_height, int& grid_width) {
+    grid_height = (height + MOTION_GRID_CELL_SIZE - 1) / MOTION_GRID_CELL_SIZE;
+    grid_width = (width + MOTION_GRID_CELL_SIZE - 1) / MOTION_GRID_CELL_SIZE;
+}
+
+
+void rasterize_motion_vectors(const MVS_DTYPE *motion_vectors, MVS_DTYPE num_mvs,
+    int grid_height, int grid_width, float *grid) {
+
+    std::size_t num_cells = (std::size_t)grid_height * grid_width;
+    if(num_cells == 0)
+        return;
+
+    // scratch buffers are kept per thread, reader threads process every frame of their stream
+    thread_local std::vector<int32_t> cells;
+    thread_local std::vector<float> weighted_dx;
+    thread_local std::vector<float> weighted_dy;
+    thread_local std::vector<float> weights;
+    thread_local std::vector<float> cell_weights;
+    cells.resize(num_mvs);
+    weighted_dx.resize(num_mvs);
+    weighted_dy.resize(num_mvs);
+    weights.resize(num_mvs);
+    // a tiny initial weight avoids a division by zero in empty cells, whose sums stay zero
+    cell_weights.assign(num_cells, 1e-30f);
+
+    // pass 1 (branch-free): cell index, weight and weighted motion of every vector
+    int32_t *cells_ = cells.data();
+    float *dx_ = weighted_dx.data();
+    float *dy_ = weighted_dy.data();
+    float *w_ = weights.data();
+    int32_t max_x = grid_width - 1;
+    int32_t max_y = grid_height - 1;
+    for(MVS_DTYPE i = 0; i < num_mvs; i++) {
+        // narrow to 32 bit first, SSE/AVX2 lack 64 bit integer to float conversions
+        const MVS_DTYPE *mv = motion_vectors + i * 10;
+        int32_t x = std::min(std::max((int32_t)mv[5] / MOTION_GRID_CELL_SIZE, 0), max_x);
+        int32_t y = std::min(std::max((int32_t)mv[6] / MOTION_GRID_CELL_SIZE, 0), max_y);
+        float weight = (float)((int32_t)mv[1] * (int32_t)mv[2]);
+        float scale = weight / (float)std::max((int32_t)mv[9], 1);
+        cells_[i] = y * grid_width + x;
+        dx_[i] = (float)(int32_t)mv[7] * scale;
+        dy_[i] = (float)(int32_t)mv[8] * scale;
+        w_[i] = weight;
+    }
+
+    // pass 2 (scalar): accumulate into the cells
+    std::fill(grid, grid + 2 * num_cells, 0.0f);
+    float *cw_ = cell_weights.data();
+    for(MVS_DTYPE i = 0; i < num_mvs; i++) {
+        grid[2 * cells_[i] + 0] += dx_[i];
+        grid[2 * cells_[i] + 1] += dy_[i];
+        cw_[cells_[i]] += w_[i];
+    }
+
+    // pass 3 (vectorizable): normalize by the accumulated weights
+    for(std::size_t c = 0; c < num_cells; c++) {
+        float inv = 1.0f / cw_[c];
+        grid[2 * c + 0] *= inv;
+        grid[2 * c + 1] *= inv;
+    }
+}
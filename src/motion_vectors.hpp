@@ -0,0 +1,53 @@
+#ifndef MOTION_VECTORS_H
+#define MOTION_VECTORS_H
+
+#include <cstdint>
+
+#include "../../video_cap/src/video_cap_validator.hpp"
+
+/*
+*    Post-processing of the (num_mvs x 10) motion vector arrays of VideoCap
+*
+*    Columns of a motion vector: 0 source, 1 w, 2 h, 3 src_x, 4 src_y, 5 dst_x,
+*    6 dst_y, 7 motion_x, 8 motion_y, 9 motion_scale (see AVMotionVector).
+*
+*    The kernels avoid branches in their inner loops so that the compiler can
+*    vectorize them (setup.py enables -ftree-vectorize) without tying the build
+*    to an instruction set. Gathering the strided 64 bit columns and scattering
+*    vectors into the grid cells remain scalar.
+*
+*/
+
+#define MVS_COMPACT_COLUMNS  4  // dst_x, dst_y, motion_x / motion_scale, motion_y / motion_scale
+#define MOTION_GRID_CELL_SIZE  16  // macroblock size in pixels
+
+struct MotionVectorConfig {
+    bool filter_zero = false;  // remove vectors with zero motion from the motion vector array
+    bool compact = false;  // provide a (num_mvs x 4) float array with the used fields
+    bool grid = false;  // provide a dense (H/16 x W/16 x 2) motion grid
+};
+
+/* removes motion vectors with motion_x = motion_y = 0 in place and returns the
+remaining number of vectors, the order of the vectors is preserved */
+MVS_DTYPE filter_zero_motion_vectors(MVS_DTYPE *motion_vectors, MVS_DTYPE num_mvs);
+
+/* writes the fields dst_x, dst_y, motion_x / motion_scale and motion_y /
+motion_scale of every motion vector into compact (num_mvs x 4 floats) */
+void compact_motion_vectors(const MVS_DTYPE *motion_vectors, MVS_DTYPE num_mvs, float *compact);
+
+/* motion activity of a frame: mean absolute motion (|motion_x| + |motion_y|)
+/ motion_scale in pixels per pixel of the frame, i.e. the sum over all vectors
+weighted by block area divided by the frame area */
+float motion_score(const MVS_DTYPE *motion_vectors, MVS_DTYPE num_mvs, int height, int width);
+
+/* size of the motion grid of a frame, partial macroblocks at the border get their own cell */
+void motion_grid_size(int height, int width, int& grid_height, int& grid_width);
+
+/* rasterises the motion vectors into grid (grid_height x grid_width x 2
+floats). Each cell holds the mean motion (motion / motion_scale in pixels) of
+all vectors whose destination lies in the cell, weighted by block area. Cells
+without vectors are zero. */
+void rasterize_motion_vectors(const MVS_DTYPE *motion_vectors, MVS_DTYPE num_mvs,
+    int grid_height, int grid_width, float *grid);
+
+#endif
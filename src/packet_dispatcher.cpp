@@ -0,0 +1,215 @@
+#include "packet_dispatcher.hpp"
+
+#include <iostream>
+
+
+// dispatcher whose thread is running the current code, so that callbacks can unregister themselves
+static thread_local const PacketDispatcher *current_dispatcher = NULL;
+
+PacketDispatcher::PacketDispatcher(std::size_t num_threads, const ThreadConfig& thread_config) {
+    this->next_callback_id = 0;
+    this->thread_config = thread_config;
+    this->stop = false;
+    this->blocked_time = 0;
+
+    if(num_threads < 1)
+        num_threads = 1;
+
+    for(std::size_t i = 0; i < num_threads; i++) {
+        this->threads.push_back(
+            std::thread(&PacketDispatcher::run, this, i)
+        );
+    }
+}
+
+
+PacketDispatcher::~PacketDispatcher() {
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+    this->stop = true;
+    mlock.unlock();
+    this->cond_.notify_all();
+    this->space_cond_.notify_all();
+
+    for(std::size_t i = 0; i < this->threads.size(); i++) {
+        this->threads[i].join();
+    }
+}
+
+
+void PacketDispatcher::run(std::size_t thread_id) {
+    apply_thread_config(this->thread_config, "ss_dispatch_" + std::to_string(thread_id));
+    current_dispatcher = this;
+
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+
+    while(1) {
+        this->cond_.wait(mlock, [this]{return (this->stop || !this->ready.empty());});
+        if(this->stop)
+            return;
+
+        int callback_id = this->ready.front();
+        this->ready.pop_front();
+
+        auto it = this->callbacks.find(callback_id);
+        if(it == this->callbacks.end())
+            continue;
+        CallbackEntry& entry = it->second;
+        entry.queued = false;
+        if(entry.removed || entry.pending.empty())
+            continue;
+
+        SSFramePacket frame_packet = std::move(entry.pending.front());
+        entry.pending.pop_front();
+        entry.running = true;
+        this->space_cond_.notify_all();
+
+        // invoke the callback without holding the lock so that dispatch() never waits for it
+        mlock.unlock();
+        auto start = std::chrono::steady_clock::now();
+        try {
+            entry.callback(frame_packet);
+        }
+        catch(const std::exception& e) {
+            std::cerr << "Frame packet callback " << callback_id << " raised an exception: " << e.what() << std::endl;
+        }
+        std::chrono::duration<double> busy = std::chrono::steady_clock::now() - start;
+        frame_packet.clear();  // release frame data before taking the lock again
+        mlock.lock();
+
+        entry.running = false;
+        entry.stats.delivered++;
+        entry.stats.busy_time += busy.count();
+
+        // entries stay valid while running, so erase removed ones only now
+        if(entry.removed) {
+            SSFramePacketCallback callback = std::move(entry.callback);
+            this->callbacks.erase(it);
+            this->idle_cond_.notify_all();
+            // the callback may hold resources (e.g. a Python object) which must not be released under the lock
+            mlock.unlock();
+            callback = nullptr;
+            mlock.lock();
+            continue;
+        }
+
+        if(!entry.pending.empty()) {
+            entry.queued = true;
+            this->ready.push_back(callback_id);
+            this->cond_.notify_one();
+        }
+    }
+}
+
+
+int PacketDispatcher::add_callback(SSFramePacketCallback callback, std::size_t max_pending) {
+    std::lock_guard<std::mutex> mlock(this->mutex_);
+
+    int callback_id = this->next_callback_id++;
+    CallbackEntry& entry = this->callbacks[callback_id];
+    entry.callback = callback;
+    entry.max_pending = (max_pending < 1) ? 1 : max_pending;
+    entry.queued = false;
+    entry.running = false;
+    entry.removed = false;
+    entry.stats = CallbackStats();
+
+    return callback_id;
+}
+
+
+bool PacketDispatcher::remove_callback(int callback_id) {
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+
+    auto it = this->callbacks.find(callback_id);
+    if(it == this->callbacks.end() || it->second.removed)
+        return false;
+
+    if(!it->second.running) {
+        SSFramePacketCallback callback = std::move(it->second.callback);
+        this->callbacks.erase(it);
+        this->space_cond_.notify_all();
+        mlock.unlock();  // release the callback after the lock
+        return true;
+    }
+
+    // the dispatcher thread erases the entry after the invocation finished
+    it->second.removed = true;
+    it->second.pending.clear();
+    this->space_cond_.notify_all();
+
+    // called from a callback, waiting would block the dispatcher thread on itself
+    // (or on another callback which waits for this one)
+    if(current_dispatcher == this)
+        return true;
+
+    this->idle_cond_.wait(mlock, [this, callback_id]{return (this->callbacks.count(callback_id) == 0);});
+    return true;
+}
+
+
+std::size_t PacketDispatcher::num_callbacks(void) {
+    std::lock_guard<std::mutex> mlock(this->mutex_);
+    return this->callbacks.size();
+}
+
+
+void PacketDispatcher::dispatch(const SSFramePacket& frame_packet, bool block_if_full) {
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+
+    // a lossless dispatch waits until every callback has room for the packet
+    if(block_if_full) {
+        auto is_full = [this]{
+            for(auto& item : this->callbacks) {
+                if(!item.second.removed && item.second.pending.size() >= item.second.max_pending)
+                    return true;
+            }
+            return false;
+        };
+        if(is_full()) {
+            auto start = std::chrono::steady_clock::now();
+            this->space_cond_.wait(mlock, [this, &is_full]{return (this->stop || !is_full());});
+            this->blocked_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    for(auto& item : this->callbacks) {
+        CallbackEntry& entry = item.second;
+        if(entry.removed)
+            continue;
+
+        if(entry.pending.size() >= entry.max_pending) {  // callback can not keep up
+            entry.pending.pop_front();
+            entry.stats.dropped++;
+        }
+
+        // the frame data is shared between all callbacks, only the packet vector is copied
+        entry.pending.push_back(frame_packet);
+
+        if(!entry.running && !entry.queued) {
+            entry.queued = true;
+            this->ready.push_back(item.first);
+        }
+    }
+
+    mlock.unlock();
+    this->cond_.notify_all();
+}
+
+
+double PacketDispatcher::time_blocked(void) {
+    std::lock_guard<std::mutex> mlock(this->mutex_);
+    return this->blocked_time;
+}
+
+
+bool PacketDispatcher::get_stats(int callback_id, CallbackStats& stats) {
+    std::lock_guard<std::mutex> mlock(this->mutex_);
+
+    auto it = this->callbacks.find(callback_id);
+    if(it == this->callbacks.end())
+        return false;
+
+    stats = it->second.stats;
+    stats.pending = it->second.pending.size();
+    return true;
+}
@@ -0,0 +1,95 @@
+#ifndef PACKET_DISPATCHER_H
+#define PACKET_DISPATCHER_H
+
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+#include "thread_config.hpp"
+#include "frame_data.hpp"
+
+/*
+*    Delivers frame packets to registered callbacks on a pool of dispatcher threads
+*
+*    Every callback has its own bounded queue of pending packets and is never
+*    invoked concurrently with itself, so packets arrive in order. If a callback
+*    is slower than packet generation its queue fills up and the oldest pending
+*    packet is dropped. A slow callback thus occupies at most one dispatcher
+*    thread and never blocks dispatch() or the other callbacks. Only a lossless
+*    dispatch waits for free space in every queue instead.
+*
+*/
+
+typedef std::function<void(const SSFramePacket&)> SSFramePacketCallback;
+
+struct CallbackStats {
+    uint64_t delivered;  // number of completed callback invocations
+    uint64_t dropped;  // number of packets dropped because the queue was full
+    std::size_t pending;  // number of packets currently queued
+    double busy_time;  // total time spent inside the callback in seconds
+};
+
+class PacketDispatcher {
+
+private:
+
+    struct CallbackEntry {
+        SSFramePacketCallback callback;
+        std::size_t max_pending;
+        std::deque<SSFramePacket> pending;
+        bool queued;  // id is in the ready queue
+        bool running;  // currently executed by a dispatcher thread
+        bool removed;
+        CallbackStats stats;
+    };
+
+    std::map<int, CallbackEntry> callbacks;
+    std::deque<int> ready;  // ids of callbacks with pending packets which are not running
+    int next_callback_id;
+    bool stop;
+    double blocked_time;  // total time dispatch() waited for free queue space
+
+    std::vector<std::thread> threads;
+    ThreadConfig thread_config;
+    std::mutex mutex_;
+    std::condition_variable cond_;  // signals dispatcher threads
+    std::condition_variable idle_cond_;  // signals the end of a callback invocation
+    std::condition_variable space_cond_;  // signals free space in a queue of pending packets
+
+    /* background thread which invokes callbacks for pending packets */
+    void run(std::size_t thread_id);
+
+public:
+
+    /* starts num_threads dispatcher threads with the given placement */
+    PacketDispatcher(std::size_t num_threads, const ThreadConfig& thread_config = ThreadConfig());
+
+    /* stops and joins the dispatcher threads, pending packets are discarded */
+    ~PacketDispatcher();
+
+    /* registers a callback and returns its id, at most max_pending packets are queued for it */
+    int add_callback(SSFramePacketCallback callback, std::size_t max_pending);
+
+    /* unregisters a callback, waits for a running invocation to finish unless
+    called from a callback (e.g. a callback which unregisters itself) */
+    bool remove_callback(int callback_id);
+
+    /* number of registered callbacks */
+    std::size_t num_callbacks(void);
+
+    /* queues the frame packet for every registered callback, if block_if_full is
+    set waits for free space in full queues instead of dropping their oldest packet */
+    void dispatch(const SSFramePacket& frame_packet, bool block_if_full = false);
+
+    /* total time in seconds dispatch() waited for free space */
+    double time_blocked(void);
+
+    /* delivery statistics of a callback, returns false if the id is unknown */
+    bool get_stats(int callback_id, CallbackStats& stats);
+};
+
+#endif
@@ -0,0 +1,399 @@
+#include "packet_recording.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "exceptions.hpp"
+
+
+#define RECORDING_GROW_SIZE  (256 << 20)  // grow the file in steps of 256 MiB
+
+
+static std::size_t align8(std::size_t value) {
+    return (value + 7) & ~(std::size_t)7;
+}
+
+
+static std::string recording_error(const char *what, const std::string& path) {
+    std::stringstream error;
+    error << what << " recording \"" << path << "\": " << strerror(errno);
+    return error.str();
+}
+
+
+PacketRecordingWriter::PacketRecordingWriter(const std::string& path, std::size_t num_streams,
+    std::size_t max_pending, const ThreadConfig& thread_config) {
+
+    this->path = path;
+    this->mem = NULL;
+    this->capacity = 0;
+    this->size = 0;
+    this->max_pending = (max_pending < 1) ? 1 : max_pending;
+    this->stop = false;
+    this->failed = false;
+    this->thread_config = thread_config;
+
+    this->fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if(this->fd < 0)
+        throw StreamProcessingError(recording_error("Could not create", path));
+
+    this->index_fd = open((path + ".idx").c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_APPEND, 0644);
+    if(this->index_fd < 0) {
+        close(this->fd);
+        throw StreamProcessingError(recording_error("Could not create index of", path));
+    }
+
+    this->reserve(sizeof(RecordingFileHeader));
+    RecordingFileHeader *file_header = reinterpret_cast<RecordingFileHeader*>(this->mem);
+    memcpy(file_header->magic, RECORDING_MAGIC, sizeof(file_header->magic));
+    file_header->num_streams = num_streams;
+    file_header->reserved = 0;
+    this->size = align8(sizeof(RecordingFileHeader));
+
+    this->thread = std::thread(&PacketRecordingWriter::run, this);
+}
+
+
+PacketRecordingWriter::~PacketRecordingWriter() {
+    // the writer thread appends the queued packets before it exits
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+    this->stop = true;
+    mlock.unlock();
+    this->cond_.notify_all();
+    this->thread.join();
+
+    if(this->mem)
+        munmap(this->mem, this->capacity);
+    // cut off the preallocated but unused tail
+    if(ftruncate(this->fd, this->size) < 0)
+        std::cerr << recording_error("Could not truncate", this->path) << std::endl;
+    close(this->fd);
+    close(this->index_fd);
+}
+
+
+void PacketRecordingWriter::reserve(std::size_t required) {
+    if(required <= this->capacity)
+        return;
+
+    std::size_t capacity = std::max(required, this->capacity + RECORDING_GROW_SIZE);
+    if(ftruncate(this->fd, capacity) < 0)
+        throw StreamProcessingError(recording_error("Could not grow", this->path));
+
+    void *mem;
+    if(this->mem)
+        mem = mremap(this->mem, this->capacity, capacity, MREMAP_MAYMOVE);
+    else
+        mem = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if(mem == MAP_FAILED)
+        throw StreamProcessingError(recording_error("Could not map", this->path));
+
+    this->mem = static_cast<uint8_t*>(mem);
+    this->capacity = capacity;
+}
+
+
+void PacketRecordingWriter::run(void) {
+    apply_thread_config(this->thread_config, "ss_record");
+
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+
+    while(1) {
+        this->cond_.wait(mlock, [this]{return (this->stop || !this->pending.empty());});
+        if(this->pending.empty())
+            return;  // stopped and all packets written
+
+        std::pair<SSFramePacket, double> item = std::move(this->pending.front());
+        this->pending.pop_front();
+        mlock.unlock();
+        this->cond_.notify_all();  // wake up write() waiting for queue space
+
+        bool success = true;
+        try {
+            this->append(item.first, item.second);
+        }
+        catch(const std::exception& e) {
+            std::cerr << e.what() << " Recording stopped." << std::endl;
+            success = false;
+        }
+        item.first.clear();  // release frame data before taking the lock again
+        mlock.lock();
+
+        if(!success) {
+            this->failed = true;
+            this->pending.clear();
+            this->cond_.notify_all();
+        }
+    }
+}
+
+
+void PacketRecordingWriter::write(const SSFramePacket& frame_packet, double packet_timestamp) {
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+
+    // the frame data is shared with the other outputs, only the packet vector is copied
+    this->cond_.wait(mlock, [this]{return (this->failed || this->pending.size() < this->max_pending);});
+    if(this->failed)
+        return;
+    this->pending.push_back(std::make_pair(frame_packet, packet_timestamp));
+
+    mlock.unlock();
+    this->cond_.notify_all();
+}
+
+
+void PacketRecordingWriter::append(const SSFramePacket& frame_packet, double packet_timestamp) {
+
+    // compute the record size first so that the mapping is grown only once
+    std::size_t record_size = align8(sizeof(RecordHeader) + frame_packet.size() * sizeof(RecordFrameHeader));
+    for(std::size_t cap_id = 0; cap_id < frame_packet.size(); cap_id++) {
+        const FrameData& frame_data = *frame_packet[cap_id];
+        if(frame_data.frame_status != FRAME_OKAY)
+            continue;
+        record_size += align8((std::size_t)frame_data.width * frame_data.height * 3);
+        record_size += align8((std::size_t)frame_data.num_mvs * 10 * sizeof(MVS_DTYPE));
+    }
+
+    this->reserve(this->size + record_size);
+
+    uint8_t *record = this->mem + this->size;
+    RecordHeader *record_header = reinterpret_cast<RecordHeader*>(record);
+    RecordFrameHeader *frame_headers = reinterpret_cast<RecordFrameHeader*>(record + sizeof(RecordHeader));
+    std::size_t offset = align8(sizeof(RecordHeader) + frame_packet.size() * sizeof(RecordFrameHeader));
+
+    for(std::size_t cap_id = 0; cap_id < frame_packet.size(); cap_id++) {
+        const FrameData& frame_data = *frame_packet[cap_id];
+        RecordFrameHeader& frame_header = frame_headers[cap_id];
+
+        memset(&frame_header, 0, sizeof(frame_header));
+        frame_header.frame_status = frame_data.frame_status;
+
+        // unchanged frames keep their timestamp and frame type, but carry no data
+        if(frame_data.frame_status == FRAME_OKAY || frame_data.frame_status == FRAME_UNCHANGED) {
+            frame_header.timestamp = frame_data.timestamp;
+            memcpy(frame_header.frame_type, frame_data.frame_type, sizeof(frame_header.frame_type));
+        }
+
+        if(frame_data.frame_status != FRAME_OKAY)
+            continue;
+
+        frame_header.height = frame_data.height;
+        frame_header.width = frame_data.width;
+        frame_header.num_mvs = frame_data.num_mvs;
+
+        std::size_t frame_size = (std::size_t)frame_data.width * frame_data.height * 3;
+        memcpy(record + offset, frame_data.frame, frame_size);
+        offset += align8(frame_size);
+
+        std::size_t mvs_size = (std::size_t)frame_data.num_mvs * 10 * sizeof(MVS_DTYPE);
+        memcpy(record + offset, frame_data.motion_vectors, mvs_size);
+        offset += align8(mvs_size);
+    }
+
+    record_header->num_frames = frame_packet.size();
+    record_header->size = record_size;
+    record_header->timestamp = packet_timestamp;
+    record_header->magic = RECORDING_RECORD_MAGIC;  // written last, marks the record as complete
+
+    RecordingIndexEntry index_entry;
+    index_entry.timestamp = packet_timestamp;
+    index_entry.offset = this->size;
+    if(::write(this->index_fd, &index_entry, sizeof(index_entry)) != sizeof(index_entry))
+        std::cerr << recording_error("Could not append to index of", this->path) << std::endl;
+
+    this->size += record_size;
+}
+
+
+PacketRecordingReader::PacketRecordingReader(const std::string& path) {
+
+    this->path = path;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw StreamProcessingError(recording_error("Could not open", path));
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) < 0) {
+        close(fd);
+        throw StreamProcessingError(recording_error("Could not stat", path));
+    }
+    this->mem_size = file_stat.st_size;
+
+    if(this->mem_size < sizeof(RecordingFileHeader)) {
+        close(fd);
+        throw StreamProcessingError("Recording \"" + path + "\" is empty.");
+    }
+
+    void *mem = mmap(NULL, this->mem_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED)
+        throw StreamProcessingError(recording_error("Could not map", path));
+    this->mem = static_cast<uint8_t*>(mem);
+
+    // replay reads sequentially
+    madvise(this->mem, this->mem_size, MADV_SEQUENTIAL);
+
+    const RecordingFileHeader *file_header = reinterpret_cast<const RecordingFileHeader*>(this->mem);
+    if(memcmp(file_header->magic, RECORDING_MAGIC, sizeof(file_header->magic)) != 0) {
+        munmap(this->mem, this->mem_size);
+        throw StreamProcessingError("File \"" + path + "\" is not a frame packet recording.");
+    }
+
+    this->load_index();
+}
+
+
+PacketRecordingReader::~PacketRecordingReader() {
+    munmap(this->mem, this->mem_size);
+}
+
+
+void PacketRecordingReader::load_index(void) {
+
+    std::size_t offset = align8(sizeof(RecordingFileHeader));
+
+    int index_fd = open((this->path + ".idx").c_str(), O_RDONLY);
+    if(index_fd >= 0) {
+        RecordingIndexEntry index_entry;
+        while(::read(index_fd, &index_entry, sizeof(index_entry)) == sizeof(index_entry)) {
+            // records follow each other, the index ends at the first entry which breaks this
+            if(!this->index.empty() && index_entry.offset <= this->index.back().offset)
+                break;
+            if(!this->record_is_valid(index_entry.offset))
+                break;
+            this->index.push_back(index_entry);
+        }
+        close(index_fd);
+    }
+
+    // continue after the last indexed record, e.g. if the recorder was killed
+    if(!this->index.empty()) {
+        const RecordHeader *last = reinterpret_cast<const RecordHeader*>(this->mem + this->index.back().offset);
+        offset = this->index.back().offset + last->size;
+    }
+
+    while(this->record_is_valid(offset)) {  // stops at an incomplete record or preallocated space
+        const RecordHeader *record_header = reinterpret_cast<const RecordHeader*>(this->mem + offset);
+
+        RecordingIndexEntry index_entry;
+        index_entry.timestamp = record_header->timestamp;
+        index_entry.offset = offset;
+        this->index.push_back(index_entry);
+        offset += record_header->size;
+    }
+}
+
+
+bool PacketRecordingReader::record_is_valid(std::size_t offset) const {
+
+    if(offset % 8 != 0 || offset > this->mem_size || this->mem_size - offset < sizeof(RecordHeader))
+        return false;
+
+    const uint8_t *record = this->mem + offset;
+    const RecordHeader *record_header = reinterpret_cast<const RecordHeader*>(record);
+    if(record_header->magic != RECORDING_RECORD_MAGIC || record_header->size < sizeof(RecordHeader) ||
+        record_header->size > this->mem_size - offset)
+        return false;
+
+    // frame headers and frame data have to fit into the record
+    std::size_t record_size = record_header->size;
+    if(record_header->num_frames > (record_size - sizeof(RecordHeader)) / sizeof(RecordFrameHeader))
+        return false;
+
+    const RecordFrameHeader *frame_headers = reinterpret_cast<const RecordFrameHeader*>(record + sizeof(RecordHeader));
+    std::size_t data_size = align8(sizeof(RecordHeader) + record_header->num_frames * sizeof(RecordFrameHeader));
+    for(std::size_t cap_id = 0; cap_id < record_header->num_frames; cap_id++) {
+        const RecordFrameHeader& frame_header = frame_headers[cap_id];
+        if(frame_header.frame_status != FRAME_OKAY)
+            continue;
+        if(frame_header.height < 0 || frame_header.width < 0 || frame_header.num_mvs < 0 ||
+            (uint64_t)frame_header.num_mvs > record_size / (10 * sizeof(MVS_DTYPE)))
+            return false;
+
+        data_size += align8((std::size_t)frame_header.width * frame_header.height * 3);
+        data_size += align8((std::size_t)frame_header.num_mvs * 10 * sizeof(MVS_DTYPE));
+        if(data_size > record_size)
+            return false;
+    }
+
+    return true;
+}
+
+
+std::size_t PacketRecordingReader::num_streams(void) const {
+    return reinterpret_cast<const RecordingFileHeader*>(this->mem)->num_streams;
+}
+
+
+std::size_t PacketRecordingReader::size(void) const {
+    return this->index.size();
+}
+
+
+double PacketRecordingReader::timestamp(std::size_t i) const {
+    return this->index[i].timestamp;
+}
+
+
+std::size_t PacketRecordingReader::find(double timestamp) const {
+    auto it = std::lower_bound(this->index.begin(), this->index.end(), timestamp,
+        [](const RecordingIndexEntry& e, double t) { return e.timestamp < t; });
+    return it - this->index.begin();
+}
+
+
+void PacketRecordingReader::read(std::size_t i, SSFramePacket& frame_packet) const {
+
+    if(i >= this->index.size() || !this->record_is_valid(this->index[i].offset)) {
+        std::stringstream error;
+        error << "Record " << i << " of recording \"" << this->path << "\" is damaged.";
+        throw StreamProcessingError(error.str());
+    }
+
+    const uint8_t *record = this->mem + this->index[i].offset;
+    const RecordHeader *record_header = reinterpret_cast<const RecordHeader*>(record);
+    const RecordFrameHeader *frame_headers = reinterpret_cast<const RecordFrameHeader*>(record + sizeof(RecordHeader));
+    std::size_t offset = align8(sizeof(RecordHeader) + record_header->num_frames * sizeof(RecordFrameHeader));
+
+    frame_packet.clear();
+
+    for(std::size_t cap_id = 0; cap_id < record_header->num_frames; cap_id++) {
+        const RecordFrameHeader& frame_header = frame_headers[cap_id];
+        std::shared_ptr<FrameData> frame_data = std::make_shared<FrameData>();
+
+        (*frame_data).frame_status = frame_header.frame_status;
+        if(frame_header.frame_status == FRAME_OKAY || frame_header.frame_status == FRAME_UNCHANGED) {
+            (*frame_data).timestamp = frame_header.timestamp;
+            memcpy((*frame_data).frame_type, frame_header.frame_type, sizeof((*frame_data).frame_type));
+            (*frame_data).frame_type[1] = '\0';
+        }
+
+        if(frame_header.frame_status == FRAME_OKAY) {
+            std::size_t frame_size = (std::size_t)frame_header.width * frame_header.height * 3;
+            std::size_t mvs_size = (std::size_t)frame_header.num_mvs * 10 * sizeof(MVS_DTYPE);
+
+            (*frame_data).height = frame_header.height;
+            (*frame_data).width = frame_header.width;
+            (*frame_data).num_mvs = frame_header.num_mvs;
+
+            (*frame_data).frame = (uint8_t*)malloc(frame_size);
+            memcpy((*frame_data).frame, record + offset, frame_size);
+            offset += align8(frame_size);
+
+            // allocate at least one element, as in VideoCap, so the pointer is always valid
+            (*frame_data).motion_vectors = (MVS_DTYPE*)malloc(std::max(mvs_size, sizeof(MVS_DTYPE)));
+            memcpy((*frame_data).motion_vectors, record + offset, mvs_size);
+            offset += align8(mvs_size);
+        }
+
+        frame_packet.push_back(std::move(frame_data));
+    }
+}
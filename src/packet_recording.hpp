@@ -0,0 +1,166 @@
+#ifndef PACKET_RECORDING_H
+#define PACKET_RECORDING_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "thread_config.hpp"
+#include "frame_data.hpp"
+
+/*
+*    Append-only recording of synchronized frame packets
+*
+*    The recording consists of a data file and an index file <path>.idx.
+*
+*    data file:  [RecordingFileHeader][record 0][record 1]...
+*    record:     [RecordHeader][RecordFrameHeader x num_frames][frame and motion vector data]
+*    index file: [RecordingIndexEntry 0][RecordingIndexEntry 1]...
+*
+*    Frames are stored decoded (raw BGR) together with their motion vectors,
+*    status, frame type and timestamp, so that a replay reproduces exactly the
+*    packets the live system produced. The index maps the packet timestamp of
+*    every record to its file offset. If it is missing or incomplete, it is
+*    rebuilt by scanning the data file. Records are validated before use, so
+*    a truncated or damaged recording is replayed up to its first bad record.
+*
+*/
+
+#define RECORDING_MAGIC  "SSREC01"
+#define RECORDING_RECORD_MAGIC  0x44524352  // "RCRD"
+
+struct RecordingFileHeader {
+    char magic[8];
+    uint32_t num_streams;
+    uint32_t reserved;
+};
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t num_frames;
+    uint64_t size;  // total size of the record including this header
+    double timestamp;  // packet timestamp
+};
+
+struct RecordFrameHeader {
+    int32_t frame_status;
+    int32_t height;
+    int32_t width;
+    char frame_type[2];
+    char reserved[2];
+    double timestamp;
+    int64_t num_mvs;
+};
+
+struct RecordingIndexEntry {
+    double timestamp;
+    uint64_t offset;
+};
+
+
+/*
+*    Appends frame packets to a recording through a growing memory mapping
+*
+*    Packets are copied into the mapping on a background thread, so that the
+*    caller only queues references to the frame data. If the disk can not keep
+*    up, write() blocks once max_pending packets are queued, so no packet is
+*    lost. After a write error the recording stops and further packets are
+*    discarded.
+*
+*/
+
+class PacketRecordingWriter {
+
+private:
+
+    std::string path;
+    int fd;
+    int index_fd;
+    uint8_t *mem;
+    std::size_t capacity;  // size of the file and the mapping
+    std::size_t size;  // bytes written
+
+    std::deque<std::pair<SSFramePacket, double> > pending;
+    std::size_t max_pending;
+    bool stop;
+    bool failed;
+    std::mutex mutex_;  // protects pending, stop and failed
+    std::condition_variable cond_;  // signals queued packets and free queue space
+
+    std::thread thread;
+    ThreadConfig thread_config;
+
+    /* grows file and mapping so that at least required bytes fit */
+    void reserve(std::size_t required);
+
+    /* copies a frame packet into the recording (called by the writer thread) */
+    void append(const SSFramePacket& frame_packet, double packet_timestamp);
+
+    /* background thread which appends the queued frame packets */
+    void run(void);
+
+public:
+
+    /* creates (truncates) the recording and starts the writer thread with the
+    given placement, throws StreamProcessingError on failure */
+    PacketRecordingWriter(const std::string& path, std::size_t num_streams,
+        std::size_t max_pending = 16, const ThreadConfig& thread_config = ThreadConfig());
+
+    /* writes the queued packets, truncates the data file to the written size and closes it */
+    ~PacketRecordingWriter();
+
+    /* queues a frame packet for appending, blocks while max_pending packets are queued */
+    void write(const SSFramePacket& frame_packet, double packet_timestamp);
+};
+
+
+/*
+*    Reads frame packets from a recording through a read-only memory mapping
+*
+*/
+
+class PacketRecordingReader {
+
+private:
+
+    std::string path;
+    uint8_t *mem;
+    std::size_t mem_size;
+    std::vector<RecordingIndexEntry> index;
+
+    /* loads the index file and scans the data file for records not contained in it */
+    void load_index(void);
+
+    /* true if a complete record with consistent frame headers starts at offset */
+    bool record_is_valid(std::size_t offset) const;
+
+public:
+
+    /* opens the recording, throws StreamProcessingError on failure */
+    PacketRecordingReader(const std::string& path);
+
+    /* unmaps the recording */
+    ~PacketRecordingReader();
+
+    /* number of streams the recording was made with */
+    std::size_t num_streams(void) const;
+
+    /* number of frame packets in the recording */
+    std::size_t size(void) const;
+
+    /* packet timestamp of the i-th frame packet */
+    double timestamp(std::size_t i) const;
+
+    /* index of the first frame packet with a packet timestamp >= timestamp */
+    std::size_t find(double timestamp) const;
+
+    /* reads the i-th frame packet, frame data is copied into newly allocated
+    buffers, throws StreamProcessingError if the record is damaged */
+    void read(std::size_t i, SSFramePacket& frame_packet) const;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "preprocessing.hpp"
+
+// OpenCV
+#include <opencv2/opencv.hpp>
+
+
+// interleaved output, the channel order is a template parameter so that the
+// compiler sees constant offsets and can vectorize the loop
+template <int C0, int C1, int C2>
+static void normalize_nhwc(const uint8_t *pixels, std::size_t num_pixels,
+    const float *a, const float *b, float *out) {
+    for(std::size_t i = 0; i < num_pixels; i++) {
+        out[3 * i + 0] = (float)pixels[3 * i + C0] * a[0] + b[0];
+        out[3 * i + 1] = (float)pixels[3 * i + C1] * a[1] + b[1];
+        out[3 * i + 2] = (float)pixels[3 * i + C2] * a[2] + b[2];
+    }
+}
+
+
+void preprocess_frame(const FrameData& frame_data, const PreprocessingConfig& config, float *out) {
+
+    std::size_t num_pixels = (std::size_t)config.height * config.width;
+
+    // resize with OpenCV (SIMD optimized and thread-safe), the buffer is reused per worker thread
+    cv::Mat frame(frame_data.height, frame_data.width, CV_8UC3, frame_data.frame);
+    thread_local cv::Mat resized;
+    const uint8_t *pixels = frame_data.frame;
+    if(frame_data.height != config.height || frame_data.width != config.width) {
+        cv::resize(frame, resized, cv::Size(config.width, config.height), 0, 0, cv::INTER_LINEAR);
+        pixels = resized.data;
+    }
+
+    // out = pixel * a + b per output channel, with input channel src[c]
+    float a[3];
+    float b[3];
+    int src[3];
+    for(int c = 0; c < 3; c++) {
+        a[c] = config.scale / config.std[c];
+        b[c] = -config.mean[c] / config.std[c];
+        src[c] = config.rgb ? 2 - c : c;
+    }
+
+    if(config.nchw) {
+        // one pass per plane keeps the writes contiguous for the vectorizer
+        for(int c = 0; c < 3; c++) {
+            float *plane = out + c * num_pixels;
+            const uint8_t *channel = pixels + src[c];
+            float a_c = a[c];
+            float b_c = b[c];
+            for(std::size_t i = 0; i < num_pixels; i++) {
+                plane[i] = (float)channel[3 * i] * a_c + b_c;
+            }
+        }
+    }
+    else if(config.rgb) {
+        normalize_nhwc<2, 1, 0>(pixels, num_pixels, a, b, out);
+    }
+    else {
+        normalize_nhwc<0, 1, 2>(pixels, num_pixels, a, b, out);
+    }
+}
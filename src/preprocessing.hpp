@@ -0,0 +1,55 @@
+#ifndef PREPROCESSING_H
+#define PREPROCESSING_H
+
+#include <cstdint>
+
+#include "frame_data.hpp"
+
+/*
+*    Conversion of the frames of a packet into a normalized float tensor
+*
+*    Every frame is resized to width x height, optionally converted from BGR to
+*    RGB and normalized per channel as (pixel * scale - mean) / std. The result
+*    is written into slice cap_id of one batched float32 tensor of the packet
+*    with layout NCHW (batch x 3 x height x width) or NHWC. Slices of frames
+*    which are not FRAME_OKAY are zero.
+*
+*/
+
+struct PreprocessingConfig {
+    int width = 0;  // output size, preprocessing is disabled if 0
+    int height = 0;
+    bool rgb = true;  // convert from BGR to RGB channel order
+    float scale = 1.0f / 255.0f;  // applied to the pixel values before mean and std
+    float mean[3] = {0.0f, 0.0f, 0.0f};  // per channel in output channel order
+    float std[3] = {1.0f, 1.0f, 1.0f};
+    bool nchw = true;  // otherwise NHWC
+    std::size_t num_threads = 2;  // worker threads in addition to the synchronization thread
+};
+
+struct PacketTensor {
+    float *data = NULL;  // malloc'ed, owned by this object
+    int batch;
+    int height;
+    int width;
+    bool nchw;
+
+    PacketTensor() = default;
+    PacketTensor(const PacketTensor&) = delete;
+    PacketTensor& operator=(const PacketTensor&) = delete;
+
+    ~PacketTensor() {
+        free(this->data);
+    }
+
+    /* number of floats of one frame */
+    std::size_t slice_size(void) const {
+        return (std::size_t)3 * this->height * this->width;
+    }
+};
+
+/* resizes, reorders and normalizes the frame into out (3 x height x width for
+NCHW or height x width x 3 for NHWC) */
+void preprocess_frame(const FrameData& frame_data, const PreprocessingConfig& config, float *out);
+
+#endif
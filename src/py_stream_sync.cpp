@@ -7,153 +7,1429 @@
 typedef struct {
     PyObject_HEAD
     StreamSynchronizer stream_synchronizer;
+    bool replay_finished;  // the end marker of a replay was returned by __anext__, zeroed by tp_alloc
 } StreamSynchronizerObject;
 
 
+static PyObject *
+StreamSynchronizer_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    StreamSynchronizerObject *self = (StreamSynchronizerObject *) type->tp_alloc(type, 0);
+    if(self != NULL)
+        new (&self->stream_synchronizer) StreamSynchronizer();  // construct the C++ object inside the Python managed memory
+    return (PyObject *) self;
+}
+
+
+// parses an optional sequence of CPU ids into cpus, returns false with an exception set on failure
+static bool
+parse_cpu_list(PyObject *cpu_list, std::vector<int>& cpus)
+{
+    cpus.clear();
+    if(!cpu_list || cpu_list == Py_None)
+        return true;
+
+    PyObject *seq = PySequence_Fast(cpu_list, "CPU list must be a sequence of integers");
+    if(!seq)
+        return false;
+
+    for(Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        long cpu = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if(cpu == -1 && PyErr_Occurred()) {
+            Py_DECREF(seq);
+            return false;
+        }
+        cpus.push_back((int)cpu);
+    }
+
+    Py_DECREF(seq);
+    return true;
+}
+
+
+// parses a sequence of three floats, returns false with an exception set on failure
+static bool
+parse_channel_values(PyObject *values, float *out)
+{
+    PyObject *seq = PySequence_Fast(values, "expected a sequence of three numbers");
+    if(!seq)
+        return false;
+    if(PySequence_Fast_GET_SIZE(seq) != 3) {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "expected a sequence of three numbers");
+        return false;
+    }
+    for(int c = 0; c < 3; c++) {
+        out[c] = (float)PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, c));
+    }
+    Py_DECREF(seq);
+    return !PyErr_Occurred();
+}
+
+
+// parses the preprocessing dictionary, returns false with an exception set on failure
+static bool
+parse_preprocessing_config(PyObject *preprocessing, PreprocessingConfig& config)
+{
+    if(!PyDict_Check(preprocessing)) {
+        PyErr_SetString(PyExc_TypeError, "preprocessing must be a dictionary");
+        return false;
+    }
+
+    PyObject *size = PyDict_GetItemString(preprocessing, "size");
+    if(!size || !PyArg_ParseTuple(size, "ii", &config.width, &config.height)) {
+        PyErr_SetString(PyExc_ValueError, "preprocessing requires the key \"size\" with a tuple (width, height)");
+        return false;
+    }
+    if(config.width <= 0 || config.height <= 0) {
+        PyErr_SetString(PyExc_ValueError, "preprocessing size must be positive");
+        return false;
+    }
+
+    PyObject *rgb = PyDict_GetItemString(preprocessing, "rgb");
+    if(rgb) {
+        int is_true = PyObject_IsTrue(rgb);
+        if(is_true < 0)
+            return false;
+        config.rgb = is_true;
+    }
+
+    PyObject *scale = PyDict_GetItemString(preprocessing, "scale");
+    if(scale) {
+        config.scale = (float)PyFloat_AsDouble(scale);
+        if(PyErr_Occurred())
+            return false;
+    }
+
+    PyObject *mean = PyDict_GetItemString(preprocessing, "mean");
+    if(mean && !parse_channel_values(mean, config.mean))
+        return false;
+
+    PyObject *std = PyDict_GetItemString(preprocessing, "std");
+    if(std && !parse_channel_values(std, config.std))
+        return false;
+
+    PyObject *layout = PyDict_GetItemString(preprocessing, "layout");
+    if(layout) {
+        const char *layout_str = PyUnicode_AsUTF8(layout);
+        if(!layout_str)
+            return false;
+        if(strcmp(layout_str, "NCHW") == 0)
+            config.nchw = true;
+        else if(strcmp(layout_str, "NHWC") == 0)
+            config.nchw = false;
+        else {
+            PyErr_SetString(PyExc_ValueError, "preprocessing layout must be \"NCHW\" or \"NHWC\"");
+            return false;
+        }
+    }
+
+    PyObject *threads = PyDict_GetItemString(preprocessing, "threads");
+    if(threads) {
+        Py_ssize_t num_threads = PyLong_AsSsize_t(threads);
+        if(num_threads < 0) {
+            if(!PyErr_Occurred())
+                PyErr_SetString(PyExc_ValueError, "preprocessing threads must not be negative");
+            return false;
+        }
+        config.num_threads = num_threads;
+    }
+
+    return true;
+}
+
+
+// parses the mosaic dictionary, returns false with an exception set on failure
+static bool
+parse_mosaic_config(PyObject *mosaic, MosaicConfig& config)
+{
+    if(!PyDict_Check(mosaic)) {
+        PyErr_SetString(PyExc_TypeError, "mosaic must be a dictionary");
+        return false;
+    }
+
+    PyObject *tile_size = PyDict_GetItemString(mosaic, "tile_size");
+    if(!tile_size || !PyArg_ParseTuple(tile_size, "ii", &config.tile_width, &config.tile_height)) {
+        PyErr_SetString(PyExc_ValueError, "mosaic requires the key \"tile_size\" with a tuple (width, height)");
+        return false;
+    }
+    if(config.tile_width <= 0 || config.tile_height <= 0) {
+        PyErr_SetString(PyExc_ValueError, "mosaic tile_size must be positive");
+        return false;
+    }
+
+    PyObject *columns = PyDict_GetItemString(mosaic, "columns");
+    if(columns) {
+        config.columns = (int)PyLong_AsLong(columns);
+        if(PyErr_Occurred())
+            return false;
+    }
+
+    PyObject *overlay = PyDict_GetItemString(mosaic, "overlay");
+    if(overlay) {
+        int is_true = PyObject_IsTrue(overlay);
+        if(is_true < 0)
+            return false;
+        config.overlay = is_true;
+    }
+
+    PyObject *threads = PyDict_GetItemString(mosaic, "threads");
+    if(threads) {
+        Py_ssize_t num_threads = PyLong_AsSsize_t(threads);
+        if(num_threads < 0) {
+            if(!PyErr_Occurred())
+                PyErr_SetString(PyExc_ValueError, "mosaic threads must not be negative");
+            return false;
+        }
+        config.num_threads = num_threads;
+    }
+
+    return true;
+}
+
+
 static int
 StreamSynchronizer_init(StreamSynchronizerObject *self, PyObject *args, PyObject *kwargs)
 {
-    static char *kwlist[] = {"cams_list",
-                             "max_initial_stream_offset",
-                             "max_read_errors",
-                             "frame_packet_buffer_maxsize",
-                             NULL};
+    static char *kwlist[] = {"cams_list",
+                             "max_initial_stream_offset",
+                             "max_read_errors",
+                             "frame_packet_buffer_maxsize",
+                             "shm_name",
+                             "shm_num_slots",
+                             "shm_slot_size",
+                             "dispatcher_threads",
+                             "history_max_packets",
+                             "history_max_bytes",
+                             "packet_ring_duration",
+                             "packet_ring_max_bytes",
+                             "record_path",
+                             "replay_path",
+                             "replay_paced",
+                             "sync_cpus",
+                             "sync_numa_node",
+                             "sync_priority",
+                             "dispatcher_cpus",
+                             "dispatcher_numa_node",
+                             "output_policy",
+                             "frame_buffer_maxsize",
+                             "mvs_filter_zero",
+                             "mvs_compact",
+                             "motion_grid",
+                             "motion_gate_threshold",
+                             "motion_gate_suppress",
+                             "motion_gate_max_interval",
+                             "preprocessing",
+                             "mosaic",
+                             "clock_correction",
+                             "clock_reference",
+                             "clock_window",
+                             "merged_output",
+                             "reorder_window",
+                             "merged_buffer_maxsize",
+                             "coordinator",
+                             "worker_id",
+                             "max_pending_frames",
+                             "max_matched_frames",
+                             "coordinator_port",
+                             "num_workers",
+                             NULL};
+
+    // list of camera dictionaries passed as argument
+    PyObject *cams_list = NULL;
+
+    // optional arguments
+    double max_initial_stream_offset = 30.0;
+    int max_read_errors = 3;
+    int frame_packet_buffer_maxsize = 1;
+    const char *shm_name = NULL;
+    Py_ssize_t shm_num_slots = 4;
+    Py_ssize_t shm_slot_size = 64 << 20;
+    Py_ssize_t dispatcher_threads = 1;
+    Py_ssize_t history_max_packets = 0;
+    Py_ssize_t history_max_bytes = 0;
+    double packet_ring_duration = 0;
+    Py_ssize_t packet_ring_max_bytes = 0;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    int replay_paced = 0;
+    PyObject *sync_cpus = NULL;
+    int sync_numa_node = -1;
+    int sync_priority = 0;
+    PyObject *dispatcher_cpus = NULL;
+    int dispatcher_numa_node = -1;
+    const char *output_policy = "latest";
+    Py_ssize_t frame_buffer_maxsize = 0;
+    int mvs_filter_zero = 0;
+    int mvs_compact = 0;
+    int motion_grid = 0;
+    double motion_gate_threshold = 0;
+    int motion_gate_suppress = 0;
+    double motion_gate_max_interval = 0;
+    PyObject *preprocessing = NULL;
+    PyObject *mosaic = NULL;
+    int clock_correction = 0;
+    int clock_reference = 0;
+    double clock_window = 60;
+    int merged_output = 0;
+    double reorder_window = 0.2;
+    Py_ssize_t merged_buffer_maxsize = 64;
+    const char *coordinator = NULL;
+    int worker_id = 0;
+    Py_ssize_t max_pending_frames = 64;
+    Py_ssize_t max_matched_frames = 32;
+    int coordinator_port = 0;
+    Py_ssize_t num_workers = 1;
+
+    std::vector<const char*> cams; // vector of camera connection urls
+
+    // parse camera list argument
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O!|$diiznnnnndnzzpOiiOisnpppdpdOOpidpdnzinnin", kwlist,
+        &PyList_Type, &cams_list, &max_initial_stream_offset,
+        &max_read_errors, &frame_packet_buffer_maxsize, &shm_name,
+        &shm_num_slots, &shm_slot_size, &dispatcher_threads,
+        &history_max_packets, &history_max_bytes, &packet_ring_duration,
+        &packet_ring_max_bytes, &record_path, &replay_path, &replay_paced,
+        &sync_cpus, &sync_numa_node, &sync_priority, &dispatcher_cpus,
+        &dispatcher_numa_node, &output_policy, &frame_buffer_maxsize,
+        &mvs_filter_zero, &mvs_compact, &motion_grid, &motion_gate_threshold,
+        &motion_gate_suppress, &motion_gate_max_interval, &preprocessing,
+        &mosaic, &clock_correction, &clock_reference, &clock_window,
+        &merged_output, &reorder_window, &merged_buffer_maxsize,
+        &coordinator, &worker_id, &max_pending_frames, &max_matched_frames,
+        &coordinator_port, &num_workers))
+        return -1;
+
+    int num_cams = PyList_Size(cams_list);
+
+    if(num_cams < 0)
+        return -1;  // not a list
+
+    for(int i = 0; i < num_cams; i++) {
+        PyObject *cam_dict = PyList_GetItem(cams_list, i);
+        PyObject *cam_source = PyDict_GetItemString(cam_dict, "source");
+        if(!cam_source)
+            return -1;  // key "source" not found
+        PyObject* cam_source_utf8_str = PyUnicode_AsUTF8String(cam_source);
+        char* cam_source_str = PyBytes_AsString(cam_source_utf8_str);
+        cams.push_back(cam_source_str);
+
+        // optional placement of the reader thread of this camera
+        ThreadConfig reader_config;
+        if(!parse_cpu_list(PyDict_GetItemString(cam_dict, "cpus"), reader_config.cpus))
+            return -1;
+        PyObject *cam_numa_node = PyDict_GetItemString(cam_dict, "numa_node");
+        if(cam_numa_node) {
+            reader_config.numa_node = (int)PyLong_AsLong(cam_numa_node);
+            if(PyErr_Occurred())
+                return -1;
+        }
+        self->stream_synchronizer.set_reader_thread_config(i, reader_config);
+    }
+
+    ThreadConfig sync_config;
+    if(!parse_cpu_list(sync_cpus, sync_config.cpus))
+        return -1;
+    sync_config.numa_node = sync_numa_node;
+    sync_config.realtime_priority = sync_priority;
+    self->stream_synchronizer.set_sync_thread_config(sync_config);
+
+    ThreadConfig dispatcher_config;
+    if(!parse_cpu_list(dispatcher_cpus, dispatcher_config.cpus))
+        return -1;
+    dispatcher_config.numa_node = dispatcher_numa_node;
+    self->stream_synchronizer.set_dispatcher_thread_config(dispatcher_config);
+
+    if(strcmp(output_policy, "latest") == 0)
+        self->stream_synchronizer.set_output_policy(OUTPUT_LATEST);
+    else if(strcmp(output_policy, "lossless") == 0)
+        self->stream_synchronizer.set_output_policy(OUTPUT_LOSSLESS);
+    else {
+        PyErr_SetString(PyExc_ValueError, "output_policy must be \"latest\" or \"lossless\"");
+        return -1;
+    }
+    self->stream_synchronizer.set_frame_buffer_maxsize(frame_buffer_maxsize);
+
+    MotionVectorConfig motion_vector_config;
+    motion_vector_config.filter_zero = mvs_filter_zero;
+    motion_vector_config.compact = mvs_compact;
+    motion_vector_config.grid = motion_grid;
+    self->stream_synchronizer.set_motion_vector_config(motion_vector_config);
+
+    if(motion_gate_threshold > 0)
+        self->stream_synchronizer.enable_motion_gate(motion_gate_threshold,
+            motion_gate_suppress, motion_gate_max_interval);
+
+    if(preprocessing && preprocessing != Py_None) {
+        PreprocessingConfig preprocessing_config;
+        if(!parse_preprocessing_config(preprocessing, preprocessing_config))
+            return -1;
+        self->stream_synchronizer.enable_preprocessing(preprocessing_config);
+    }
+
+    if(mosaic && mosaic != Py_None) {
+        MosaicConfig mosaic_config;
+        if(!parse_mosaic_config(mosaic, mosaic_config))
+            return -1;
+        self->stream_synchronizer.enable_mosaic(mosaic_config);
+    }
+
+    if(clock_correction) {
+        if(clock_reference < CLOCK_HOST_REFERENCE || clock_reference >= num_cams) {
+            PyErr_SetString(PyExc_ValueError, "clock_reference must be the index of a camera or -1 for the host clock");
+            return -1;
+        }
+        if(clock_window <= 0) {
+            PyErr_SetString(PyExc_ValueError, "clock_window must be positive");
+            return -1;
+        }
+        self->stream_synchronizer.enable_clock_correction(clock_reference, clock_window);
+    }
+
+    if(merged_output) {
+        if(merged_buffer_maxsize <= 0) {
+            PyErr_SetString(PyExc_ValueError, "merged_buffer_maxsize must be positive");
+            return -1;
+        }
+        self->stream_synchronizer.enable_merged_output(reorder_window, merged_buffer_maxsize);
+    }
+
+    if(coordinator) {
+        if(worker_id < 0) {
+            PyErr_SetString(PyExc_ValueError, "worker_id must not be negative");
+            return -1;
+        }
+        if(max_pending_frames <= 0 || max_matched_frames <= 0) {
+            PyErr_SetString(PyExc_ValueError, "max_pending_frames and max_matched_frames must be positive");
+            return -1;
+        }
+        self->stream_synchronizer.enable_ingest_worker(coordinator, worker_id,
+            max_pending_frames, max_matched_frames);
+    }
+
+    if(coordinator_port < 0 || coordinator_port > 65535 || num_workers <= 0) {
+        PyErr_SetString(PyExc_ValueError, "coordinator_port must be a port number and num_workers positive");
+        return -1;
+    }
+
+    if(shm_name)
+        self->stream_synchronizer.enable_shm_output(shm_name, shm_num_slots, shm_slot_size);
+
+    self->stream_synchronizer.set_dispatcher_threads(dispatcher_threads);
+
+    if(history_max_packets > 0 || history_max_bytes > 0)
+        self->stream_synchronizer.enable_history(history_max_packets, history_max_bytes);
+
+    if(packet_ring_duration > 0 || packet_ring_max_bytes > 0)
+        self->stream_synchronizer.enable_packet_ring(packet_ring_duration, packet_ring_max_bytes);
+
+    if(record_path)
+        self->stream_synchronizer.enable_recording(record_path);
+
+    try {
+        // a replay and a coordinator ignore the camera list
+        if(coordinator_port > 0)
+            self->stream_synchronizer.init_coordinator(coordinator_port, num_workers,
+                max_initial_stream_offset, frame_packet_buffer_maxsize);
+        else if(replay_path)
+            self->stream_synchronizer.init_replay(replay_path, replay_paced,
+                frame_packet_buffer_maxsize);
+        else
+            self->stream_synchronizer.init(cams, max_initial_stream_offset,
+                max_read_errors, frame_packet_buffer_maxsize);
+    }
+    catch(const StreamProcessingError& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+StreamSynchronizer_dealloc(StreamSynchronizerObject *self)
+{
+    self->stream_synchronizer.~StreamSynchronizer();  // might be called automatically
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+
+static PyObject *
+frame_status_to_string(int frame_status)
+{
+    if (frame_status == FRAME_OKAY)
+        return PyUnicode_FromString("FRAME_OKAY");
+    else if (frame_status == FRAME_DROPPED)
+        return PyUnicode_FromString("FRAME_DROPPED");
+    else if (frame_status == FRAME_READ_ERROR)
+        return PyUnicode_FromString("FRAME_READ_ERROR");
+    else if (frame_status == CAP_BROKEN)
+        return PyUnicode_FromString("CAP_BROKEN");
+    else if (frame_status == FRAME_UNCHANGED)
+        return PyUnicode_FromString("FRAME_UNCHANGED");
+    return NULL;
+}
+
+
+static void
+frame_data_capsule_destructor(PyObject *capsule)
+{
+    delete (std::shared_ptr<FrameData> *) PyCapsule_GetPointer(capsule, "stream_sync.FrameData");
+}
+
+
+static PyObject *
+frame_data_capsule(const std::shared_ptr<FrameData>& frame_data)
+{
+    std::shared_ptr<FrameData> *frame_data_ref = new std::shared_ptr<FrameData>(frame_data);
+    PyObject *capsule = PyCapsule_New(frame_data_ref, "stream_sync.FrameData", frame_data_capsule_destructor);
+    if(!capsule)
+        delete frame_data_ref;
+    return capsule;
+}
+
+
+static void
+packet_tensor_capsule_destructor(PyObject *capsule)
+{
+    delete (std::shared_ptr<PacketTensor> *) PyCapsule_GetPointer(capsule, "stream_sync.PacketTensor");
+}
+
+
+// batched numpy array of the packet tensor, which stays alive as long as the array
+static PyObject *
+packet_tensor_to_array(const std::shared_ptr<PacketTensor>& tensor)
+{
+    std::shared_ptr<PacketTensor> *tensor_ref = new std::shared_ptr<PacketTensor>(tensor);
+    PyObject *capsule = PyCapsule_New(tensor_ref, "stream_sync.PacketTensor", packet_tensor_capsule_destructor);
+    if(!capsule) {
+        delete tensor_ref;
+        return NULL;
+    }
+
+    npy_intp dims_nchw[4] = {(npy_intp)tensor->batch, 3, (npy_intp)tensor->height, (npy_intp)tensor->width};
+    npy_intp dims_nhwc[4] = {(npy_intp)tensor->batch, (npy_intp)tensor->height, (npy_intp)tensor->width, 3};
+    PyObject *tensor_nd = PyArray_SimpleNewFromData(4, tensor->nchw ? dims_nchw : dims_nhwc, NPY_FLOAT32, tensor->data);
+    if(!tensor_nd) {
+        Py_DECREF(capsule);
+        return NULL;
+    }
+    PyArray_SetBaseObject((PyArrayObject*)tensor_nd, capsule);
+    return tensor_nd;
+}
+
+
+// dictionary with the data of one frame, returns NULL on failure
+static PyObject *
+frame_data_to_dict(const std::shared_ptr<FrameData>& frame_data)
+{
+    int ret;
+
+    PyObject *frame_data_dict = PyDict_New(); // dictionary containing data of one frame
+    if(!frame_data_dict)
+        return NULL;
+
+    // insert frame status into frame data dict
+    PyObject *frame_status = frame_status_to_string(frame_data->frame_status);
+    ret = PyDict_SetItemString(frame_data_dict, "frame_status", frame_status);
+    if(!frame_status || ret < 0)
+        return NULL;
+    Py_XDECREF(frame_status);
+
+    // frames of a coordinator can be fetched from their ingest worker by sequence number
+    if(frame_data->sequence > 0) {
+        PyObject *sequence = PyLong_FromUnsignedLongLong(frame_data->sequence);
+        ret = PyDict_SetItemString(frame_data_dict, "sequence", sequence);
+        if(!sequence || ret < 0)
+            return NULL;
+        Py_XDECREF(sequence);
+    }
+
+    // check if frame is valid, otherwise insert NONE into fields
+    // motion score of the motion gate
+    if(frame_data->motion_score >= 0) {
+        PyObject *motion_score = PyFloat_FromDouble(frame_data->motion_score);
+        ret = PyDict_SetItemString(frame_data_dict, "motion_score", motion_score);
+        if(!motion_score || ret < 0)
+            return NULL;
+        Py_XDECREF(motion_score);
+    }
+
+    // unchanged frames and the metadata of frames on a coordinator keep their
+    // timestamp and frame type, but carry no data
+    if(frame_data->frame_status == FRAME_UNCHANGED || (frame_data->frame_status == FRAME_OKAY && !frame_data->frame)) {
+        PyObject *timestamp = PyFloat_FromDouble(frame_data->timestamp);
+        ret = PyDict_SetItemString(frame_data_dict, "timestamp", timestamp);
+        if(!timestamp || ret < 0)
+            return NULL;
+        Py_XDECREF(timestamp);
+
+        PyObject *frame_type = PyUnicode_FromString(frame_data->frame_type);
+        ret = PyDict_SetItemString(frame_data_dict, "frame_type", frame_type);
+        if(!frame_type || ret < 0)
+            return NULL;
+        Py_XDECREF(frame_type);
+
+        if(PyDict_SetItemString(frame_data_dict, "frame", Py_None) < 0)
+            return NULL;
+
+        if(PyDict_SetItemString(frame_data_dict, "motion_vector", Py_None) < 0)
+            return NULL;
+    }
+    else if(frame_data->frame_status != FRAME_OKAY) {
+        if(PyDict_SetItemString(frame_data_dict, "timestamp", Py_None) < 0)
+            return NULL;
+
+        if(PyDict_SetItemString(frame_data_dict, "frame_type", Py_None) < 0)
+            return NULL;
+
+        if(PyDict_SetItemString(frame_data_dict, "frame", Py_None) < 0)
+            return NULL;
+
+        if(PyDict_SetItemString(frame_data_dict, "motion_vector", Py_None) < 0)
+            return NULL;
+    }
+    // if frame is valid insert actual data into the frame data dict
+    else {
+        PyObject *timestamp = PyFloat_FromDouble(frame_data->timestamp);
+        ret = PyDict_SetItemString(frame_data_dict, "timestamp", timestamp);
+        if(!timestamp || ret < 0)
+            return NULL;
+        Py_XDECREF(timestamp);
+
+        PyObject *frame_type = PyUnicode_FromString(frame_data->frame_type);
+        ret = PyDict_SetItemString(frame_data_dict, "frame_type", frame_type);
+        if(!frame_type || ret < 0)
+            return NULL;
+        Py_XDECREF(frame_type);
+
+        // the arrays reference the frame data buffers which stay alive as long as the capsule
+        PyObject *capsule = frame_data_capsule(frame_data);
+        if(!capsule)
+            return NULL;
+
+        // convert frame buffer into numpy array
+        npy_intp dims_frame[3] = {(npy_intp)(frame_data->height), (npy_intp)(frame_data->width), 3};
+        PyObject *np_frame_nd = PyArray_SimpleNewFromData(3, dims_frame, NPY_UINT8, frame_data->frame);
+        Py_INCREF(capsule);
+        PyArray_SetBaseObject((PyArrayObject*)np_frame_nd, capsule);
+
+        // convert motion vector buffer into numpy array
+        npy_intp dims_mvs[2] = {(npy_intp)frame_data->num_mvs, 10};
+        PyObject *motion_vectors_nd = PyArray_SimpleNewFromData(2, dims_mvs, MVS_DTYPE_NP, frame_data->motion_vectors);
+        Py_INCREF(capsule);
+        PyArray_SetBaseObject((PyArrayObject*)motion_vectors_nd, capsule);
+
+        // optional outputs of the motion vector post-processing
+        if(frame_data->compact_motion_vectors) {
+            npy_intp dims_compact[2] = {(npy_intp)frame_data->num_mvs, MVS_COMPACT_COLUMNS};
+            PyObject *compact_nd = PyArray_SimpleNewFromData(2, dims_compact, NPY_FLOAT32, frame_data->compact_motion_vectors);
+            Py_INCREF(capsule);
+            PyArray_SetBaseObject((PyArrayObject*)compact_nd, capsule);
+            if(PyDict_SetItemString(frame_data_dict, "motion_vector_compact", compact_nd) < 0)
+                return NULL;
+            Py_XDECREF(compact_nd);
+        }
+
+        if(frame_data->motion_grid) {
+            npy_intp dims_grid[3] = {(npy_intp)frame_data->grid_height, (npy_intp)frame_data->grid_width, 2};
+            PyObject *grid_nd = PyArray_SimpleNewFromData(3, dims_grid, NPY_FLOAT32, frame_data->motion_grid);
+            Py_INCREF(capsule);
+            PyArray_SetBaseObject((PyArrayObject*)grid_nd, capsule);
+            if(PyDict_SetItemString(frame_data_dict, "motion_grid", grid_nd) < 0)
+                return NULL;
+            Py_XDECREF(grid_nd);
+        }
+        Py_DECREF(capsule);
+
+        // insert items into python dictionary
+        if(PyDict_SetItemString(frame_data_dict, "frame", np_frame_nd) < 0)
+            return NULL;
+        Py_XDECREF(np_frame_nd);
+
+        if(PyDict_SetItemString(frame_data_dict, "motion_vector", motion_vectors_nd) < 0)
+            return NULL;
+        Py_XDECREF(motion_vectors_nd);
+    }
+
+    return frame_data_dict;
+}
+
+
+static void
+packet_mosaic_capsule_destructor(PyObject *capsule)
+{
+    delete (std::shared_ptr<PacketMosaic> *) PyCapsule_GetPointer(capsule, "stream_sync.PacketMosaic");
+}
+
+
+// numpy array of the mosaic image, which stays alive as long as the array
+static PyObject *
+packet_mosaic_to_array(const std::shared_ptr<PacketMosaic>& mosaic)
+{
+    std::shared_ptr<PacketMosaic> *mosaic_ref = new std::shared_ptr<PacketMosaic>(mosaic);
+    PyObject *capsule = PyCapsule_New(mosaic_ref, "stream_sync.PacketMosaic", packet_mosaic_capsule_destructor);
+    if(!capsule) {
+        delete mosaic_ref;
+        return NULL;
+    }
+
+    npy_intp dims[3] = {(npy_intp)mosaic->height, (npy_intp)mosaic->width, 3};
+    PyObject *mosaic_nd = PyArray_SimpleNewFromData(3, dims, NPY_UINT8, mosaic->data);
+    if(!mosaic_nd) {
+        Py_DECREF(capsule);
+        return NULL;
+    }
+    PyArray_SetBaseObject((PyArrayObject*)mosaic_nd, capsule);
+    return mosaic_nd;
+}
+
+
+static PyObject *
+frame_packet_to_dict(const SSFramePacket& frame_packet)
+{
+    PyObject *frame_packet_dict = PyDict_New(); // output dictionary containing the frame packet
+    if(!frame_packet_dict)
+        Py_RETURN_NONE;
+
+    // all frames of a packet reference the same tensor, each gets a view of its slice
+    PyObject *tensor_nd = NULL;
+    if(!frame_packet.empty() && frame_packet[0]->tensor) {
+        tensor_nd = packet_tensor_to_array(frame_packet[0]->tensor);
+        if(!tensor_nd)
+            Py_RETURN_NONE;
+    }
+
+    // the mosaic is one image for the whole packet, every frame refers to it
+    PyObject *mosaic_nd = NULL;
+    if(!frame_packet.empty() && frame_packet[0]->mosaic) {
+        mosaic_nd = packet_mosaic_to_array(frame_packet[0]->mosaic);
+        if(!mosaic_nd)
+            Py_RETURN_NONE;
+    }
+
+    // convert frame_packet into python dictionary
+    for (std::size_t cap_id = 0; cap_id < frame_packet.size(); cap_id++) {
+
+        int ret;
+
+        PyObject *frame_data_dict = frame_data_to_dict(frame_packet[cap_id]);
+        if(!frame_data_dict)
+            Py_RETURN_NONE;
+
+        if(tensor_nd) {
+            PyObject *slice_nd = PySequence_GetItem(tensor_nd, cap_id);
+            ret = slice_nd ? PyDict_SetItemString(frame_data_dict, "tensor", slice_nd) : -1;
+            Py_XDECREF(slice_nd);
+            if(ret < 0)
+                Py_RETURN_NONE;
+        }
+
+        if(mosaic_nd && PyDict_SetItemString(frame_data_dict, "mosaic", mosaic_nd) < 0)
+            Py_RETURN_NONE;
+
+        // insert the frame data into the frame_packet_dict with cap_id as key
+        PyObject* key = PyLong_FromLong((long)cap_id);
+        if(PyDict_SetItem(frame_packet_dict, key, frame_data_dict) < 0)
+            Py_RETURN_NONE;
+        Py_XDECREF(frame_data_dict);
+    }
+
+    Py_XDECREF(tensor_nd);
+    Py_XDECREF(mosaic_nd);
+    return frame_packet_dict;
+}
+
+
+static PyObject *
+StreamSynchronizer_get_frame_packet(StreamSynchronizerObject *self, PyObject *Py_UNUSED(ignored))
+{
+    SSFramePacket frame_packet;
+
+    // do not block other Python threads while waiting for the next packet
+    Py_BEGIN_ALLOW_THREADS
+    frame_packet = self->stream_synchronizer.get_frame_packet();
+    Py_END_ALLOW_THREADS
+
+    return frame_packet_to_dict(frame_packet);
+}
+
+
+static PyObject *
+StreamSynchronizer_get_next_frame(StreamSynchronizerObject *self, PyObject *Py_UNUSED(ignored))
+{
+    std::shared_ptr<FrameData> frame_data;
+    std::string error;
+
+    // do not block other Python threads while waiting for the next frame,
+    // the exception must not leave the block without the GIL
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        frame_data = self->stream_synchronizer.get_next_frame();
+    }
+    catch(const StreamProcessingError& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if(!frame_data) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+
+    PyObject *frame_data_dict = frame_data_to_dict(frame_data);
+    if(!frame_data_dict)
+        Py_RETURN_NONE;
+    return Py_BuildValue("(iN)", frame_data->cap_id, frame_data_dict);
+}
+
+
+static PyObject *
+StreamSynchronizer_try_get_frame_packet(StreamSynchronizerObject *self, PyObject *Py_UNUSED(ignored))
+{
+    SSFramePacket frame_packet;
+    if(!self->stream_synchronizer.try_get_frame_packet(frame_packet))
+        Py_RETURN_NONE;
+
+    return frame_packet_to_dict(frame_packet);
+}
+
+
+static PyObject *
+StreamSynchronizer_fileno(StreamSynchronizerObject *self, PyObject *Py_UNUSED(ignored))
+{
+    return PyLong_FromLong(self->stream_synchronizer.get_frame_packet_fd());
+}
+
+
+static PyObject *
+StreamSynchronizer_get_packet_at(StreamSynchronizerObject *self, PyObject *args)
+{
+    double timestamp;
+    if(!PyArg_ParseTuple(args, "d", &timestamp))
+        return NULL;
+
+    SSFramePacket frame_packet;
+    double packet_timestamp;
+    if(!self->stream_synchronizer.get_packet_at(timestamp, frame_packet, packet_timestamp))
+        Py_RETURN_NONE;
+
+    return frame_packet_to_dict(frame_packet);
+}
+
+
+static PyObject *
+StreamSynchronizer_get_packets_between(StreamSynchronizerObject *self, PyObject *args)
+{
+    double timestamp0;
+    double timestamp1;
+    if(!PyArg_ParseTuple(args, "dd", &timestamp0, &timestamp1))
+        return NULL;
+
+    std::vector<SSFramePacket> frame_packets;
+    std::vector<double> packet_timestamps;
+    self->stream_synchronizer.get_packets_between(timestamp0, timestamp1, frame_packets, packet_timestamps);
+
+    PyObject *frame_packet_list = PyList_New(frame_packets.size());
+    if(!frame_packet_list)
+        return NULL;
+
+    for(std::size_t i = 0; i < frame_packets.size(); i++) {
+        PyObject *frame_packet_dict = frame_packet_to_dict(frame_packets[i]);
+        PyList_SET_ITEM(frame_packet_list, i, frame_packet_dict);  // steals the reference
+    }
+
+    return frame_packet_list;
+}
+
+
+static PyObject *
+StreamSynchronizer_export_clip(StreamSynchronizerObject *self, PyObject *args)
+{
+    double timestamp0;
+    double timestamp1;
+    const char *directory = NULL;
+    if(!PyArg_ParseTuple(args, "dds", &timestamp0, &timestamp1, &directory))
+        return NULL;
+
+    std::vector<ExportedClip> clips;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        clips = self->stream_synchronizer.export_clip(timestamp0, timestamp1, directory);
+    }
+    catch(const StreamProcessingError& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if(!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+
+    PyObject *clip_list = PyList_New(clips.size());
+    if(!clip_list)
+        return NULL;
+    for(std::size_t i = 0; i < clips.size(); i++) {
+        PyObject *clip = Py_BuildValue("{s:n,s:s,s:d}",
+            "cap_id", (Py_ssize_t)clips[i].cap_id,
+            "path", clips[i].path.c_str(),
+            "timestamp", clips[i].timestamp);
+        if(!clip) {
+            Py_DECREF(clip_list);
+            return NULL;
+        }
+        PyList_SET_ITEM(clip_list, i, clip);
+    }
+    return clip_list;
+}
+
+
+static PyObject *
+StreamSynchronizer_register_callback(StreamSynchronizerObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"callback", "max_pending", NULL};
+
+    PyObject *callable = NULL;
+    Py_ssize_t max_pending = 2;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", kwlist, &callable, &max_pending))
+        return NULL;
+
+    if(!PyCallable_Check(callable)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+
+    // the C++ callback owns a reference to the Python callable, which is released with the GIL held
+    Py_INCREF(callable);
+    std::shared_ptr<PyObject> callable_ref(callable, [](PyObject *obj) {
+        PyGILState_STATE gstate = PyGILState_Ensure();
+        Py_DECREF(obj);
+        PyGILState_Release(gstate);
+    });
+
+    // runs on a dispatcher thread
+    auto callback = [callable_ref](const SSFramePacket& frame_packet) {
+        PyGILState_STATE gstate = PyGILState_Ensure();
+        PyObject *frame_packet_dict = frame_packet_to_dict(frame_packet);
+        PyObject *ret = PyObject_CallFunctionObjArgs(callable_ref.get(), frame_packet_dict, NULL);
+        if(!ret)
+            PyErr_Print();
+        Py_XDECREF(ret);
+        Py_XDECREF(frame_packet_dict);
+        PyGILState_Release(gstate);
+    };
+
+    int callback_id = self->stream_synchronizer.register_callback(callback, max_pending);
+    return PyLong_FromLong(callback_id);
+}
+
+
+static PyObject *
+StreamSynchronizer_unregister_callback(StreamSynchronizerObject *self, PyObject *args)
+{
+    int callback_id;
+    if(!PyArg_ParseTuple(args, "i", &callback_id))
+        return NULL;
+
+    // a running callback needs the GIL to finish
+    bool success;
+    Py_BEGIN_ALLOW_THREADS
+    success = self->stream_synchronizer.unregister_callback(callback_id);
+    Py_END_ALLOW_THREADS
+
+    return PyBool_FromLong(success);
+}
+
+
+static PyObject *
+StreamSynchronizer_get_callback_stats(StreamSynchronizerObject *self, PyObject *args)
+{
+    int callback_id;
+    if(!PyArg_ParseTuple(args, "i", &callback_id))
+        return NULL;
 
-    // list of camera dictionaries passed as argument
-    PyObject *cams_list = NULL;
+    CallbackStats stats;
+    if(!self->stream_synchronizer.get_callback_stats(callback_id, stats)) {
+        PyErr_SetString(PyExc_KeyError, "unknown callback id");
+        return NULL;
+    }
 
-    // optional arguments
-    double max_initial_stream_offset = 30.0;
-    int max_read_errors = 3;
-    int frame_packet_buffer_maxsize = 1;
+    return Py_BuildValue("{s:K,s:K,s:n,s:d}",
+        "delivered", (unsigned long long)stats.delivered,
+        "dropped", (unsigned long long)stats.dropped,
+        "pending", (Py_ssize_t)stats.pending,
+        "busy_time", stats.busy_time);
+}
 
-    std::vector<const char*> cams; // vector of camera connection urls
 
-    // parse camera list argument
-    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O!|$dii", kwlist,
-        &PyList_Type, &cams_list, &max_initial_stream_offset,
-        &max_read_errors, &frame_packet_buffer_maxsize))
-        return -1;
+static PyObject *
+StreamSynchronizer_get_output_stats(StreamSynchronizerObject *self, PyObject *Py_UNUSED(ignored))
+{
+    OutputStats stats;
+    self->stream_synchronizer.get_output_stats(stats);
 
-    int num_cams = PyList_Size(cams_list);
+    PyObject *dropped_frames = PyList_New(stats.dropped_frames.size());
+    if(!dropped_frames)
+        return NULL;
+    for(std::size_t cap_id = 0; cap_id < stats.dropped_frames.size(); cap_id++) {
+        PyList_SET_ITEM(dropped_frames, cap_id, PyLong_FromUnsignedLongLong(stats.dropped_frames[cap_id]));
+    }
 
-    if(num_cams < 0)
-        return -1;  // not a list
+    PyObject *unchanged_frames = PyList_New(stats.unchanged_frames.size());
+    if(!unchanged_frames) {
+        Py_DECREF(dropped_frames);
+        return NULL;
+    }
+    for(std::size_t cap_id = 0; cap_id < stats.unchanged_frames.size(); cap_id++) {
+        PyList_SET_ITEM(unchanged_frames, cap_id, PyLong_FromUnsignedLongLong(stats.unchanged_frames[cap_id]));
+    }
 
-    for(int i = 0; i < num_cams; i++) {
-        PyObject *cam_dict = PyList_GetItem(cams_list, i);
-        PyObject *cam_source = PyDict_GetItemString(cam_dict, "source");
-        if(!cam_source)
-            return -1;  // key "source" not found
-        PyObject* cam_source_utf8_str = PyUnicode_AsUTF8String(cam_source);
-        char* cam_source_str = PyBytes_AsString(cam_source_utf8_str);
-        cams.push_back(cam_source_str);
+    return Py_BuildValue("{s:K,s:d,s:N,s:K,s:N,s:K}",
+        "dropped_packets", (unsigned long long)stats.dropped_packets,
+        "blocked_time", stats.blocked_time,
+        "dropped_frames", dropped_frames,
+        "suppressed_packets", (unsigned long long)stats.suppressed_packets,
+        "unchanged_frames", unchanged_frames,
+        "late_frames", (unsigned long long)stats.late_frames);
+}
+
+
+static PyObject *
+StreamSynchronizer_fetch_frames(StreamSynchronizerObject *self, PyObject *args)
+{
+    PyObject *frame_packet_dict;
+    if(!PyArg_ParseTuple(args, "O!", &PyDict_Type, &frame_packet_dict))
+        return NULL;
+
+    // valid frames with a sequence number are fetched, all others passed through
+    SSFramePacket frame_packet;
+    PyObject *key;
+    PyObject *frame_data_dict;
+    Py_ssize_t pos = 0;
+    while(PyDict_Next(frame_packet_dict, &pos, &key, &frame_data_dict)) {
+        long cap_id = PyLong_AsLong(key);
+        if(PyErr_Occurred())
+            return NULL;
+        if(!PyDict_Check(frame_data_dict)) {
+            PyErr_SetString(PyExc_TypeError, "frame_packet must map cap_id to frame dictionaries");
+            return NULL;
+        }
+
+        PyObject *sequence = PyDict_GetItemString(frame_data_dict, "sequence");
+        PyObject *frame_status = PyDict_GetItemString(frame_data_dict, "frame_status");
+        PyObject *timestamp = PyDict_GetItemString(frame_data_dict, "timestamp");
+        if(!sequence || !frame_status || !PyUnicode_Check(frame_status)
+            || strcmp(PyUnicode_AsUTF8(frame_status), "FRAME_OKAY") != 0)
+            continue;
+
+        std::shared_ptr<FrameData> frame_data = std::make_shared<FrameData>();
+        (*frame_data).cap_id = (int)cap_id;
+        (*frame_data).sequence = PyLong_AsUnsignedLongLong(sequence);
+        (*frame_data).frame_status = FRAME_OKAY;
+        (*frame_data).timestamp = timestamp ? PyFloat_AsDouble(timestamp) : 0;
+        strcpy((*frame_data).frame_type, "?");
+        if(PyErr_Occurred())
+            return NULL;
+        frame_packet.push_back(std::move(frame_data));
+    }
+
+    SSFramePacket fetched;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        self->stream_synchronizer.fetch_frames(frame_packet, fetched);
+    }
+    catch(const StreamProcessingError& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if(!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+
+    PyObject *fetched_dict = PyDict_Copy(frame_packet_dict);
+    if(!fetched_dict)
+        return NULL;
+    for(std::size_t i = 0; i < fetched.size(); i++) {
+        PyObject *fetched_data_dict = frame_data_to_dict(fetched[i]);
+        if(!fetched_data_dict) {
+            Py_DECREF(fetched_dict);
+            Py_RETURN_NONE;
+        }
+        PyObject *fetched_key = PyLong_FromLong((long)fetched[i]->cap_id);
+        int ret = fetched_key ? PyDict_SetItem(fetched_dict, fetched_key, fetched_data_dict) : -1;
+        Py_XDECREF(fetched_key);
+        Py_DECREF(fetched_data_dict);
+        if(ret < 0) {
+            Py_DECREF(fetched_dict);
+            return NULL;
+        }
+    }
+    return fetched_dict;
+}
+
+
+static PyObject *
+StreamSynchronizer_get_clock_estimates(StreamSynchronizerObject *self, PyObject *Py_UNUSED(ignored))
+{
+    std::vector<ClockEstimate> estimates;
+    self->stream_synchronizer.get_clock_estimates(estimates);
+
+    PyObject *estimates_list = PyList_New(estimates.size());
+    if(!estimates_list)
+        return NULL;
+    for(std::size_t cap_id = 0; cap_id < estimates.size(); cap_id++) {
+        PyObject *estimate = Py_BuildValue("{s:O,s:d,s:d,s:d,s:n}",
+            "valid", estimates[cap_id].valid ? Py_True : Py_False,
+            "offset", estimates[cap_id].offset,
+            "drift", estimates[cap_id].drift,
+            "correction", estimates[cap_id].correction,
+            "num_samples", (Py_ssize_t)estimates[cap_id].num_samples);
+        if(!estimate) {
+            Py_DECREF(estimates_list);
+            return NULL;
+        }
+        PyList_SET_ITEM(estimates_list, cap_id, estimate);
+    }
+    return estimates_list;
+}
+
+
+/*
+*    asyncio integration: "async for frame_packet in stream_synchronizer"
+*
+*    __anext__ returns an asyncio future of the running event loop. If no packet
+*    is available yet, the eventfd of the output buffer is registered as reader
+*    with the loop and the future is resolved from the reader callback. The
+*    empty frame packet which marks the end of a replay ends the iteration with
+*    StopAsyncIteration.
+*
+*/
+
+
+// resolves the future with the frame packet, or with StopAsyncIteration at the end of a replay
+static PyObject *
+StreamSynchronizer_set_future_result(StreamSynchronizerObject *self, PyObject *future, const SSFramePacket& frame_packet)
+{
+    if(frame_packet.empty()) {
+        self->replay_finished = true;
+        return PyObject_CallMethod(future, "set_exception", "O", PyExc_StopAsyncIteration);
+    }
+
+    PyObject *frame_packet_dict = frame_packet_to_dict(frame_packet);
+    if(!frame_packet_dict)
+        return NULL;
+    PyObject *ret = PyObject_CallMethod(future, "set_result", "O", frame_packet_dict);
+    Py_DECREF(frame_packet_dict);
+    return ret;
+}
+
+static PyObject *
+StreamSynchronizer_on_readable(PyObject *context, PyObject *Py_UNUSED(ignored))
+{
+    // context is a tuple (stream_synchronizer, loop, future)
+    StreamSynchronizerObject *self = (StreamSynchronizerObject *) PyTuple_GET_ITEM(context, 0);
+    PyObject *loop = PyTuple_GET_ITEM(context, 1);
+    PyObject *future = PyTuple_GET_ITEM(context, 2);
+    int fd = self->stream_synchronizer.get_frame_packet_fd();
+
+    // future was cancelled, do not consume a packet for it
+    PyObject *done = PyObject_CallMethod(future, "done", NULL);
+    if(!done)
+        return NULL;
+    int is_done = PyObject_IsTrue(done);
+    Py_DECREF(done);
+    if(is_done) {
+        return PyObject_CallMethod(loop, "remove_reader", "i", fd);
+    }
+
+    SSFramePacket frame_packet;
+    if(!self->stream_synchronizer.try_get_frame_packet(frame_packet))
+        Py_RETURN_NONE;  // another consumer was faster, keep waiting
+
+    PyObject *ret = PyObject_CallMethod(loop, "remove_reader", "i", fd);
+    if(!ret)
+        return NULL;
+    Py_DECREF(ret);
+
+    return StreamSynchronizer_set_future_result(self, future, frame_packet);
+}
+
+
+static PyMethodDef StreamSynchronizer_on_readable_def = {
+    "_on_readable", (PyCFunction) StreamSynchronizer_on_readable, METH_NOARGS, NULL
+};
+
+
+static PyObject *
+StreamSynchronizer_aiter(PyObject *self)
+{
+    Py_INCREF(self);
+    return self;
+}
+
+
+static PyObject *
+StreamSynchronizer_anext(StreamSynchronizerObject *self)
+{
+    // no more packets follow the end marker of a replay
+    if(self->replay_finished) {
+        PyErr_SetNone(PyExc_StopAsyncIteration);
+        return NULL;
+    }
+
+    PyObject *asyncio = PyImport_ImportModule("asyncio");
+    if(!asyncio)
+        return NULL;
+    PyObject *loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+    Py_DECREF(asyncio);
+    if(!loop)
+        return NULL;
+
+    PyObject *future = PyObject_CallMethod(loop, "create_future", NULL);
+    if(!future) {
+        Py_DECREF(loop);
+        return NULL;
+    }
+
+    PyObject *ret = NULL;
+    SSFramePacket frame_packet;
+    if(self->stream_synchronizer.try_get_frame_packet(frame_packet)) {
+        ret = StreamSynchronizer_set_future_result(self, future, frame_packet);
+    }
+    else {
+        PyObject *context = PyTuple_Pack(3, (PyObject *) self, loop, future);
+        PyObject *callback = PyCFunction_New(&StreamSynchronizer_on_readable_def, context);
+        Py_XDECREF(context);
+        if(callback) {
+            ret = PyObject_CallMethod(loop, "add_reader", "iO",
+                self->stream_synchronizer.get_frame_packet_fd(), callback);
+            Py_DECREF(callback);
+        }
+    }
+
+    Py_DECREF(loop);
+    if(!ret) {
+        Py_DECREF(future);
+        return NULL;
     }
+    Py_DECREF(ret);
+    return future;
+}
+
+
+static PyAsyncMethods StreamSynchronizer_async_methods = {
+    .am_await = NULL,
+    .am_aiter = (unaryfunc) StreamSynchronizer_aiter,
+    .am_anext = (unaryfunc) StreamSynchronizer_anext,
+};
+
+
+static PyMethodDef StreamSynchronizer_methods[] = {
+    {"get_frame_packet", (PyCFunction) StreamSynchronizer_get_frame_packet, METH_NOARGS, "Get the next set of synchronized frames from each stream"},
+    {"try_get_frame_packet", (PyCFunction) StreamSynchronizer_try_get_frame_packet, METH_NOARGS, "Get the next set of synchronized frames if available without blocking, otherwise return None"},
+    {"get_next_frame", (PyCFunction) StreamSynchronizer_get_next_frame, METH_NOARGS, "Get the next frame of the merged output as tuple (cap_id, frame_data), blocks until available"},
+    {"fileno", (PyCFunction) StreamSynchronizer_fileno, METH_NOARGS, "File descriptor which becomes readable once a frame packet is available"},
+    {"get_packet_at", (PyCFunction) StreamSynchronizer_get_packet_at, METH_VARARGS, "Get the frame packet from the history which is closest to the given timestamp"},
+    {"get_packets_between", (PyCFunction) StreamSynchronizer_get_packets_between, METH_VARARGS, "Get all frame packets from the history between two timestamps"},
+    {"export_clip", (PyCFunction) StreamSynchronizer_export_clip, METH_VARARGS, "Export the encoded packets of a time range as one MP4 file per stream without re-encoding"},
+    {"register_callback", (PyCFunction)(void(*)(void)) StreamSynchronizer_register_callback, METH_VARARGS | METH_KEYWORDS, "Invoke a callable with every frame packet on a dispatcher thread instead of queueing it for get_frame_packet"},
+    {"unregister_callback", (PyCFunction) StreamSynchronizer_unregister_callback, METH_VARARGS, "Remove a callback registered with register_callback"},
+    {"get_callback_stats", (PyCFunction) StreamSynchronizer_get_callback_stats, METH_VARARGS, "Delivery statistics of a registered callback"},
+    {"get_output_stats", (PyCFunction) StreamSynchronizer_get_output_stats, METH_NOARGS, "Counters of dropped frame packets and frames and of the time spent waiting for the consumer"},
+    {"get_clock_estimates", (PyCFunction) StreamSynchronizer_get_clock_estimates, METH_NOARGS, "Estimated clock offset and drift of every stream"},
+    {"fetch_frames", (PyCFunction) StreamSynchronizer_fetch_frames, METH_VARARGS, "Fetch the frames of a frame packet of the coordinator from the ingest workers"},
+    {NULL}  // Sentinel
+};
+
+
+static PyTypeObject StreamSynchronizerType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "h264extract.StreamSynchronizer",
+    .tp_basicsize = sizeof(StreamSynchronizerObject),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor) StreamSynchronizer_dealloc,
+    .tp_print = NULL,
+    .tp_getattr = NULL,
+    .tp_setattr = NULL,
+    .tp_as_async = &StreamSynchronizer_async_methods,
+    .tp_repr = NULL,
+    .tp_as_number = NULL,
+    .tp_as_sequence = NULL,
+    .tp_as_mapping = NULL,
+    .tp_hash = NULL,
+    .tp_call = NULL,
+    .tp_str = NULL,
+    .tp_getattro = NULL,
+    .tp_setattro = NULL,
+    .tp_as_buffer = NULL,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Stream Synchronizer Object",
+    .tp_traverse = NULL,
+    .tp_clear = NULL,
+    .tp_richcompare = NULL,
+    .tp_weaklistoffset = 0,
+    .tp_iter = NULL,
+    .tp_iternext = NULL,
+    .tp_methods = StreamSynchronizer_methods,
+    .tp_members = NULL,
+    .tp_getset = NULL,
+    .tp_base = NULL,
+    .tp_dict = NULL,
+    .tp_descr_get = NULL,
+    .tp_descr_set = NULL,
+    .tp_dictoffset = 0,
+    .tp_init = (initproc) StreamSynchronizer_init,
+    .tp_alloc = NULL,
+    .tp_new = StreamSynchronizer_new,
+    .tp_free = NULL,
+    .tp_is_gc = NULL,
+    .tp_bases = NULL,
+    .tp_mro = NULL,
+    .tp_cache = NULL,
+    .tp_subclasses = NULL,
+    .tp_weaklist = NULL,
+    .tp_del = NULL,
+    .tp_version_tag = 0,
+    .tp_finalize  = NULL,
+};
+
+
+typedef struct {
+    PyObject_HEAD
+    ShmPacketReader *reader;
+    ShmPacketView *packet_view;  // most recently returned packet
+} ShmPacketReaderObject;
 
-    self->stream_synchronizer.init(cams, max_initial_stream_offset,
-        max_read_errors, frame_packet_buffer_maxsize);
+
+static int
+ShmPacketReader_init(ShmPacketReaderObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"shm_name", NULL};
+
+    const char *shm_name = NULL;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "s", kwlist, &shm_name))
+        return -1;
+
+    try {
+        self->reader = new ShmPacketReader(shm_name);
+    }
+    catch(const StreamProcessingError& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+    self->packet_view = new ShmPacketView();
 
     return 0;
 }
 
 
 static void
-StreamSynchronizer_dealloc(StreamSynchronizerObject *self)
+ShmPacketReader_dealloc(ShmPacketReaderObject *self)
 {
-    self->stream_synchronizer.~StreamSynchronizer();  // might be called automatically
+    delete self->packet_view;
+    delete self->reader;
     Py_TYPE(self)->tp_free((PyObject *) self);
 }
 
 
 static PyObject *
-StreamSynchronizer_get_frame_packet(StreamSynchronizerObject *self, PyObject *Py_UNUSED(ignored))
+ShmPacketReader_get_frame_packet(ShmPacketReaderObject *self, PyObject *args, PyObject *kwargs)
 {
-    PyObject *frame_packet_dict = PyDict_New(); // output dictionary containing the frame packet
-    if(!frame_packet_dict)
-        Py_RETURN_NONE;
+    static char *kwlist[] = {"timeout", NULL};
 
-    SSFramePacket frame_packet = self->stream_synchronizer.get_frame_packet();
+    double timeout = -1.0;  // in seconds
 
-    // convert frame_packet into python dictionary
-    for (std::size_t cap_id = 0; cap_id < frame_packet.size(); cap_id++) {
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|d", kwlist, &timeout))
+        return NULL;
 
-        int ret;
+    if(!self->reader) {
+        PyErr_SetString(PyExc_RuntimeError, "ShmPacketReader is not initialized");
+        return NULL;
+    }
 
-        PyObject *frame_data_dict = PyDict_New(); // dictionary containing data of one frame
-        if(!frame_data_dict)
-            Py_RETURN_NONE;
+    bool success;
+    int timeout_ms = (timeout < 0) ? -1 : (int)(timeout * 1000);
+    Py_BEGIN_ALLOW_THREADS
+    success = self->reader->next(*self->packet_view, timeout_ms);
+    Py_END_ALLOW_THREADS
 
-        // insert frame status into frame data dict
-        PyObject *frame_status = NULL;
-        if (frame_packet[cap_id]->frame_status == FRAME_OKAY) {
-            frame_status = PyUnicode_FromString("FRAME_OKAY");
-        }
-        else if (frame_packet[cap_id]->frame_status == FRAME_DROPPED) {
-            frame_status = PyUnicode_FromString("FRAME_DROPPED");
-        }
-        else if (frame_packet[cap_id]->frame_status == FRAME_READ_ERROR) {
-            frame_status = PyUnicode_FromString("FRAME_READ_ERROR");
-        }
-        else if (frame_packet[cap_id]->frame_status == CAP_BROKEN) {
-            frame_status = PyUnicode_FromString("CAP_BROKEN");
-        }
-        ret = PyDict_SetItemString(frame_data_dict, "frame_status", frame_status);
-        if(!frame_status || ret < 0)
-            Py_RETURN_NONE;
-        Py_XDECREF(frame_status);
+    if(!success)
+        Py_RETURN_NONE;  // timeout
 
-        // check if frame is valid, otherwise insert NONE into fields
-        if(frame_packet[cap_id]->frame_status != FRAME_OKAY) {
-            if(PyDict_SetItemString(frame_data_dict, "timestamp", Py_None) < 0)
-                Py_RETURN_NONE;
+    PyObject *frame_packet_dict = PyDict_New();
+    if(!frame_packet_dict)
+        return NULL;
 
-            if(PyDict_SetItemString(frame_data_dict, "frame_type", Py_None) < 0)
-                Py_RETURN_NONE;
+    for (std::size_t cap_id = 0; cap_id < self->packet_view->frames.size(); cap_id++) {
 
-            if(PyDict_SetItemString(frame_data_dict, "frame", Py_None) < 0)
-                Py_RETURN_NONE;
+        const ShmFrameView& frame_view = self->packet_view->frames[cap_id];
 
-            if(PyDict_SetItemString(frame_data_dict, "motion_vector", Py_None) < 0)
-                Py_RETURN_NONE;
+        PyObject *frame_data_dict = PyDict_New();
+        if(!frame_data_dict)
+            return NULL;
+
+        PyObject *frame_status = frame_status_to_string(frame_view.frame_status);
+        if(!frame_status || PyDict_SetItemString(frame_data_dict, "frame_status", frame_status) < 0)
+            return NULL;
+        Py_XDECREF(frame_status);
+
+        // unchanged frames and frames which did not fit into the slot keep their timestamp and frame type
+        if(frame_view.frame_status != FRAME_OKAY && frame_view.frame_status != FRAME_UNCHANGED) {
+            PyDict_SetItemString(frame_data_dict, "timestamp", Py_None);
+            PyDict_SetItemString(frame_data_dict, "frame_type", Py_None);
         }
-        // if frame is valid insert actual data into the frame data dict
         else {
-            PyObject *timestamp = PyFloat_FromDouble(frame_packet[cap_id]->timestamp);
-            ret = PyDict_SetItemString(frame_data_dict, "timestamp", timestamp);
-            if(!timestamp || ret < 0)
-                Py_RETURN_NONE;
+            PyObject *timestamp = PyFloat_FromDouble(frame_view.timestamp);
+            if(!timestamp || PyDict_SetItemString(frame_data_dict, "timestamp", timestamp) < 0)
+                return NULL;
             Py_XDECREF(timestamp);
 
-            PyObject *frame_type = PyUnicode_FromString(frame_packet[cap_id]->frame_type);
-            ret = PyDict_SetItemString(frame_data_dict, "frame_type", frame_type);
-            if(!frame_type || ret < 0)
-                Py_RETURN_NONE;
+            char frame_type_str[2] = {frame_view.frame_type[0], '\0'};
+            PyObject *frame_type = PyUnicode_FromString(frame_type_str);
+            if(!frame_type || PyDict_SetItemString(frame_data_dict, "frame_type", frame_type) < 0)
+                return NULL;
             Py_XDECREF(frame_type);
+        }
 
-            // convert frame buffer into numpy array
-            npy_intp dims_frame[3] = {(npy_intp)(frame_packet[cap_id]->height), (npy_intp)(frame_packet[cap_id]->width), 3};
-            PyObject *np_frame_nd = PyArray_SimpleNewFromData(3, dims_frame, NPY_UINT8, frame_packet[cap_id]->frame);
-            PyArray_ENABLEFLAGS((PyArrayObject*)np_frame_nd, NPY_ARRAY_OWNDATA); // tell numpy it has to free the data
+        if(frame_view.frame_status != FRAME_OKAY || !frame_view.frame) {
+            PyDict_SetItemString(frame_data_dict, "frame", Py_None);
+            PyDict_SetItemString(frame_data_dict, "motion_vector", Py_None);
+        }
+        else {
+            // read-only numpy arrays referencing the shared memory, the reader object is kept alive as their base
+            npy_intp dims_frame[3] = {(npy_intp)frame_view.height, (npy_intp)frame_view.width, 3};
+            PyObject *np_frame_nd = PyArray_New(&PyArray_Type, 3, dims_frame, NPY_UINT8, NULL,
+                (void*)frame_view.frame, 0, NPY_ARRAY_C_CONTIGUOUS, NULL);
+            Py_INCREF(self);
+            PyArray_SetBaseObject((PyArrayObject*)np_frame_nd, (PyObject*)self);
 
-            // convert motion vector buffer into numpy array
-            npy_intp dims_mvs[2] = {(npy_intp)frame_packet[cap_id]->num_mvs, 10};
-            PyObject *motion_vectors_nd = PyArray_SimpleNewFromData(2, dims_mvs, MVS_DTYPE_NP, frame_packet[cap_id]->motion_vectors);
-            PyArray_ENABLEFLAGS((PyArrayObject*)motion_vectors_nd, NPY_ARRAY_OWNDATA);
+            npy_intp dims_mvs[2] = {(npy_intp)frame_view.num_mvs, 10};
+            PyObject *motion_vectors_nd = PyArray_New(&PyArray_Type, 2, dims_mvs, MVS_DTYPE_NP, NULL,
+                (void*)frame_view.motion_vectors, 0, NPY_ARRAY_C_CONTIGUOUS, NULL);
+            Py_INCREF(self);
+            PyArray_SetBaseObject((PyArrayObject*)motion_vectors_nd, (PyObject*)self);
 
-            // insert items into python dictionary
             if(PyDict_SetItemString(frame_data_dict, "frame", np_frame_nd) < 0)
-                Py_RETURN_NONE;
+                return NULL;
             Py_XDECREF(np_frame_nd);
 
             if(PyDict_SetItemString(frame_data_dict, "motion_vector", motion_vectors_nd) < 0)
-                Py_RETURN_NONE;
+                return NULL;
             Py_XDECREF(motion_vectors_nd);
         }
 
-        // insert the frame data into the frame_packet_dict with cap_id as key
         PyObject* key = PyLong_FromLong((long)cap_id);
         if(PyDict_SetItem(frame_packet_dict, key, frame_data_dict) < 0)
-            Py_RETURN_NONE;
+            return NULL;
+        Py_XDECREF(key);
         Py_XDECREF(frame_data_dict);
     }
 
@@ -161,18 +1437,38 @@ StreamSynchronizer_get_frame_packet(StreamSynchronizerObject *self, PyObject *Py
 }
 
 
-static PyMethodDef StreamSynchronizer_methods[] = {
-    {"get_frame_packet", (PyCFunction) StreamSynchronizer_get_frame_packet, METH_NOARGS, "Get the next set of synchronized frames from each stream"},
+static PyObject *
+ShmPacketReader_is_valid(ShmPacketReaderObject *self, PyObject *Py_UNUSED(ignored))
+{
+    if(!self->reader || !self->packet_view->slot)
+        Py_RETURN_FALSE;
+    return PyBool_FromLong(self->reader->is_valid(*self->packet_view));
+}
+
+
+static PyObject *
+ShmPacketReader_overruns(ShmPacketReaderObject *self, PyObject *Py_UNUSED(ignored))
+{
+    if(!self->reader)
+        return PyLong_FromLong(0);
+    return PyLong_FromUnsignedLongLong(self->reader->overruns());
+}
+
+
+static PyMethodDef ShmPacketReader_methods[] = {
+    {"get_frame_packet", (PyCFunction)(void(*)(void)) ShmPacketReader_get_frame_packet, METH_VARARGS | METH_KEYWORDS, "Wait for the next frame packet in the shared memory ring, returns None on timeout"},
+    {"is_valid", (PyCFunction) ShmPacketReader_is_valid, METH_NOARGS, "Check that the last returned frame packet has not been overwritten by the writer"},
+    {"overruns", (PyCFunction) ShmPacketReader_overruns, METH_NOARGS, "Number of frame packets skipped because the reader was too slow"},
     {NULL}  // Sentinel
 };
 
 
-static PyTypeObject StreamSynchronizerType = {
+static PyTypeObject ShmPacketReaderType = {
     PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "h264extract.StreamSynchronizer",
-    .tp_basicsize = sizeof(StreamSynchronizerObject),
+    .tp_name = "stream_sync.ShmPacketReader",
+    .tp_basicsize = sizeof(ShmPacketReaderObject),
     .tp_itemsize = 0,
-    .tp_dealloc = (destructor) StreamSynchronizer_dealloc,
+    .tp_dealloc = (destructor) ShmPacketReader_dealloc,
     .tp_print = NULL,
     .tp_getattr = NULL,
     .tp_setattr = NULL,
@@ -188,14 +1484,14 @@ static PyTypeObject StreamSynchronizerType = {
     .tp_setattro = NULL,
     .tp_as_buffer = NULL,
     .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_doc = "Stream Synchronizer Object",
+    .tp_doc = "Reader for frame packets published into shared memory by a StreamSynchronizer",
     .tp_traverse = NULL,
     .tp_clear = NULL,
     .tp_richcompare = NULL,
     .tp_weaklistoffset = 0,
     .tp_iter = NULL,
     .tp_iternext = NULL,
-    .tp_methods = StreamSynchronizer_methods,
+    .tp_methods = ShmPacketReader_methods,
     .tp_members = NULL,
     .tp_getset = NULL,
     .tp_base = NULL,
@@ -203,7 +1499,7 @@ static PyTypeObject StreamSynchronizerType = {
     .tp_descr_get = NULL,
     .tp_descr_set = NULL,
     .tp_dictoffset = 0,
-    .tp_init = (initproc) StreamSynchronizer_init,
+    .tp_init = (initproc) ShmPacketReader_init,
     .tp_alloc = NULL,
     .tp_new = PyType_GenericNew,
     .tp_free = NULL,
@@ -232,15 +1528,25 @@ PyInit_stream_sync(void)
 {
     import_array();
 
+#if PY_VERSION_HEX < 0x03070000
+    PyEval_InitThreads();  // callbacks acquire the GIL from dispatcher threads
+#endif
+
     PyObject *m;
     if (PyType_Ready(&StreamSynchronizerType) < 0)
         return NULL;
 
+    if (PyType_Ready(&ShmPacketReaderType) < 0)
+        return NULL;
+
     m = PyModule_Create(&streamsyncmodule);
     if (m == NULL)
         return NULL;
 
     Py_INCREF(&StreamSynchronizerType);
     PyModule_AddObject(m, "StreamSynchronizer", (PyObject *) &StreamSynchronizerType);
+
+    Py_INCREF(&ShmPacketReaderType);
+    PyModule_AddObject(m, "ShmPacketReader", (PyObject *) &ShmPacketReaderType);
     return m;
 }
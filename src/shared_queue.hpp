@@ -32,6 +32,53 @@ class SharedQueue
     queue_.pop();
   }
 
+  bool try_pop(T& item)
+  {
+    std::lock_guard<std::mutex> mlock(mutex_);
+    if (queue_.empty())
+    {
+      return false;
+    }
+    item = queue_.front();
+    queue_.pop();
+    return true;
+  }
+
+  // removes the front item if pred holds for it, check and removal happen
+  // under one lock so that push_drop_oldest can not drop the item in between
+  template <typename Predicate>
+  bool pop_if(T& item, Predicate pred)
+  {
+    std::lock_guard<std::mutex> mlock(mutex_);
+    if (queue_.empty() || !pred(queue_.front()))
+    {
+      return false;
+    }
+    item = std::move(queue_.front());
+    queue_.pop();
+    return true;
+  }
+
+  // removes the front items while pred holds for them, item is set to the last
+  // removed one and the ones before it are counted as dropped
+  template <typename Predicate>
+  bool pop_while(T& item, Predicate pred)
+  {
+    std::lock_guard<std::mutex> mlock(mutex_);
+    bool popped = false;
+    while (!queue_.empty() && pred(queue_.front()))
+    {
+      if (popped)
+      {
+        dropped_++;
+      }
+      item = std::move(queue_.front());
+      queue_.pop();
+      popped = true;
+    }
+    return popped;
+  }
+
   void push(const T& item)
   {
     std::unique_lock<std::mutex> mlock(mutex_);
@@ -48,6 +95,21 @@ class SharedQueue
     cond_.notify_one();
   }
 
+  // inserts the item and removes the oldest items while the queue holds more
+  // than maxsize items, maxsize 0 does not limit the size
+  void push_drop_oldest(T&& item, std::size_t maxsize)
+  {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    queue_.push(std::move(item));
+    while (maxsize > 0 && queue_.size() > maxsize)
+    {
+      queue_.pop();
+      dropped_++;
+    }
+    mlock.unlock();
+    cond_.notify_one();
+  }
+
   bool front(T& item)
   {
     std::lock_guard<std::mutex> mlock(mutex_);
@@ -70,6 +132,13 @@ class SharedQueue
     return true;
   }
 
+  // number of items removed by push_drop_oldest and skipped by pop_while
+  uint64_t num_dropped(void)
+  {
+    std::lock_guard<std::mutex> mlock(mutex_);
+    return dropped_;
+  }
+
   std::size_t size(void)
   {
     std::size_t size;
@@ -81,6 +150,7 @@ class SharedQueue
 
  private:
   std::queue<T> queue_;
+  uint64_t dropped_ = 0;
   std::mutex mutex_;
   std::condition_variable cond_;
 };
@@ -0,0 +1,334 @@
+#include "shm_packet_ring.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "exceptions.hpp"
+
+
+static std::size_t align_up(std::size_t value, std::size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+
+static std::size_t ring_header_size(void) {
+    return align_up(sizeof(ShmRingHeader), 64);
+}
+
+
+static std::size_t frame_headers_offset(void) {
+    return align_up(sizeof(ShmSlotHeader), 16);
+}
+
+
+static std::size_t slot_data_offset(std::size_t num_streams) {
+    return align_up(frame_headers_offset() + num_streams * sizeof(ShmFrameHeader), 64);
+}
+
+
+// shared (not process private) futex operations so that waiters in other processes are woken up
+static void futex_wake_all(std::atomic<uint32_t> *futex_word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(futex_word), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+
+static void futex_wait(const std::atomic<uint32_t> *futex_word, uint32_t expected, int timeout_ms) {
+    struct timespec timeout;
+    struct timespec *timeout_ptr = NULL;
+    if(timeout_ms >= 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        timeout_ptr = &timeout;
+    }
+    syscall(SYS_futex, reinterpret_cast<const uint32_t*>(futex_word), FUTEX_WAIT, expected, timeout_ptr, NULL, 0);
+}
+
+
+static std::string shm_error(const char *what, const std::string& shm_name) {
+    std::stringstream error;
+    error << what << " shared memory ring \"" << shm_name << "\": " << strerror(errno);
+    return error.str();
+}
+
+
+ShmPacketWriter::ShmPacketWriter(const std::string& shm_name, std::size_t num_streams,
+    std::size_t num_slots, std::size_t slot_size) {
+
+    this->shm_name = shm_name;
+    slot_size = align_up(slot_size, 64);
+
+    if(num_slots == 0 || slot_size <= slot_data_offset(num_streams))
+        throw StreamProcessingError("Shared memory ring needs at least one slot which can hold the packet headers.");
+
+    this->mem_size = ring_header_size() + num_slots * slot_size;
+
+    // a stale ring is replaced, readers which still map it keep the old object
+    int fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd < 0 && errno == EEXIST) {
+        shm_unlink(shm_name.c_str());
+        fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if(fd < 0)
+        throw StreamProcessingError(shm_error("Could not create", shm_name));
+
+    if(ftruncate(fd, this->mem_size) < 0) {
+        close(fd);
+        throw StreamProcessingError(shm_error("Could not resize", shm_name));
+    }
+
+    void *mem = mmap(NULL, this->mem_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED)
+        throw StreamProcessingError(shm_error("Could not map", shm_name));
+
+    this->mem = static_cast<uint8_t*>(mem);
+    this->header = new (this->mem) ShmRingHeader();
+    this->header->num_slots = num_slots;
+    this->header->slot_size = slot_size;
+    this->header->num_streams = num_streams;
+    this->header->futex_word.store(0);
+    this->header->write_seq.store(0);
+    for(std::size_t i = 0; i < num_slots; i++) {
+        ShmSlotHeader *slot = new (this->mem + ring_header_size() + i * slot_size) ShmSlotHeader();
+        slot->seq.store(0);
+    }
+    this->header->version = SHM_RING_VERSION;
+    // readers check the magic last, so it is written once the header is complete
+    std::atomic_thread_fence(std::memory_order_release);
+    this->header->magic = SHM_RING_MAGIC;
+}
+
+
+ShmPacketWriter::~ShmPacketWriter() {
+    munmap(this->mem, this->mem_size);
+    shm_unlink(this->shm_name.c_str());
+}
+
+
+uint8_t *ShmPacketWriter::slot_ptr(uint64_t seq) {
+    return this->mem + ring_header_size() + (seq % this->header->num_slots) * this->header->slot_size;
+}
+
+
+void ShmPacketWriter::publish(const SSFramePacket& frame_packet, double packet_timestamp) {
+
+    uint64_t seq = this->header->write_seq.load(std::memory_order_relaxed) + 1;
+    uint8_t *slot_mem = this->slot_ptr(seq);
+    ShmSlotHeader *slot = reinterpret_cast<ShmSlotHeader*>(slot_mem);
+    ShmFrameHeader *frame_headers = reinterpret_cast<ShmFrameHeader*>(slot_mem + frame_headers_offset());
+
+    // invalidate the slot so that readers still holding a view of it notice the overwrite
+    slot->seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::size_t num_frames = std::min(frame_packet.size(), (std::size_t)this->header->num_streams);
+    std::size_t offset = slot_data_offset(this->header->num_streams);
+
+    for(std::size_t cap_id = 0; cap_id < num_frames; cap_id++) {
+        const FrameData& frame_data = *frame_packet[cap_id];
+        ShmFrameHeader& frame_header = frame_headers[cap_id];
+
+        frame_header.frame_status = frame_data.frame_status;
+        frame_header.timestamp = 0;
+        frame_header.height = 0;
+        frame_header.width = 0;
+        memset(frame_header.frame_type, 0, sizeof(frame_header.frame_type));
+        frame_header.frame_offset = 0;
+        frame_header.frame_size = 0;
+        frame_header.mvs_offset = 0;
+        frame_header.num_mvs = 0;
+
+        // unchanged frames keep their timestamp and frame type, but carry no data
+        if(frame_data.frame_status == FRAME_OKAY || frame_data.frame_status == FRAME_UNCHANGED) {
+            frame_header.timestamp = frame_data.timestamp;
+            memcpy(frame_header.frame_type, frame_data.frame_type, sizeof(frame_header.frame_type));
+        }
+
+        if(frame_data.frame_status != FRAME_OKAY)
+            continue;
+
+        frame_header.height = frame_data.height;
+        frame_header.width = frame_data.width;
+
+        std::size_t frame_size = (std::size_t)frame_data.width * frame_data.height * 3;
+        std::size_t mvs_size = (std::size_t)frame_data.num_mvs * 10 * sizeof(MVS_DTYPE);
+        std::size_t mvs_offset = align_up(offset + frame_size, 64);
+
+        // frames which do not fit into the remaining slot space are published without data
+        if(mvs_offset + mvs_size > this->header->slot_size) {
+            std::cerr << "Frame of stream " << cap_id << " does not fit into shared memory slot." << std::endl;
+            continue;
+        }
+
+        memcpy(slot_mem + offset, frame_data.frame, frame_size);
+        memcpy(slot_mem + mvs_offset, frame_data.motion_vectors, mvs_size);
+
+        frame_header.frame_offset = offset;
+        frame_header.frame_size = frame_size;
+        frame_header.mvs_offset = mvs_offset;
+        frame_header.num_mvs = frame_data.num_mvs;
+
+        offset = align_up(mvs_offset + mvs_size, 64);
+    }
+
+    slot->timestamp = packet_timestamp;
+    slot->num_frames = num_frames;
+    slot->seq.store(seq, std::memory_order_release);
+
+    this->header->write_seq.store(seq, std::memory_order_release);
+    this->header->futex_word.fetch_add(1, std::memory_order_release);
+    futex_wake_all(&this->header->futex_word);
+}
+
+
+ShmPacketReader::ShmPacketReader(const std::string& shm_name) {
+
+    this->shm_name = shm_name;
+    this->num_overruns = 0;
+
+    int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+        throw StreamProcessingError(shm_error("Could not open", shm_name));
+
+    struct stat shm_stat;
+    if(fstat(fd, &shm_stat) < 0) {
+        close(fd);
+        throw StreamProcessingError(shm_error("Could not stat", shm_name));
+    }
+    this->mem_size = shm_stat.st_size;
+
+    void *mem = mmap(NULL, this->mem_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED)
+        throw StreamProcessingError(shm_error("Could not map", shm_name));
+
+    this->mem = static_cast<uint8_t*>(mem);
+    this->header = reinterpret_cast<const ShmRingHeader*>(this->mem);
+
+    if(this->mem_size < ring_header_size() || this->header->magic != SHM_RING_MAGIC
+        || this->header->version != SHM_RING_VERSION) {
+        munmap(this->mem, this->mem_size);
+        throw StreamProcessingError("Shared memory ring \"" + shm_name + "\" is not initialized or has an incompatible version.");
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // slots are addressed with this geometry, so it has to fit into the mapping
+    this->num_slots = this->header->num_slots;
+    this->slot_size = this->header->slot_size;
+    this->num_streams = this->header->num_streams;
+    if(this->num_slots == 0 || this->slot_size <= slot_data_offset(this->num_streams)
+        || this->num_slots > (this->mem_size - ring_header_size()) / this->slot_size) {
+        munmap(this->mem, this->mem_size);
+        throw StreamProcessingError("Shared memory ring \"" + shm_name + "\" is damaged, its slots do not fit into its size.");
+    }
+
+    // start with the most recently published packet
+    uint64_t write_seq = this->header->write_seq.load(std::memory_order_acquire);
+    this->last_seq = (write_seq > 0) ? write_seq - 1 : 0;
+}
+
+
+ShmPacketReader::~ShmPacketReader() {
+    munmap(this->mem, this->mem_size);
+}
+
+
+bool ShmPacketReader::next(ShmPacketView& packet_view, int timeout_ms) {
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    while(1) {
+        // read the futex word before checking the condition to not miss a wake up
+        uint32_t futex_value = this->header->futex_word.load(std::memory_order_acquire);
+        uint64_t write_seq = this->header->write_seq.load(std::memory_order_acquire);
+
+        if(write_seq > this->last_seq) {
+            uint64_t seq = this->last_seq + 1;
+
+            // the writer overtook the reader, continue with the most recent packet
+            if(write_seq - seq >= this->num_slots - 1) {
+                this->num_overruns += write_seq - seq;
+                seq = write_seq;
+            }
+
+            const uint8_t *slot_mem = this->mem + ring_header_size() + (seq % this->num_slots) * this->slot_size;
+            const ShmSlotHeader *slot = reinterpret_cast<const ShmSlotHeader*>(slot_mem);
+            const ShmFrameHeader *frame_headers = reinterpret_cast<const ShmFrameHeader*>(slot_mem + frame_headers_offset());
+
+            this->last_seq = seq;
+            if(slot->seq.load(std::memory_order_acquire) != seq) {
+                this->num_overruns++;
+                continue;  // slot is already being overwritten
+            }
+
+            packet_view.seq = seq;
+            packet_view.timestamp = slot->timestamp;
+            packet_view.slot = slot;
+            packet_view.frames.resize(std::min(slot->num_frames, this->num_streams));
+
+            for(std::size_t cap_id = 0; cap_id < packet_view.frames.size(); cap_id++) {
+                const ShmFrameHeader& frame_header = frame_headers[cap_id];
+                ShmFrameView& frame_view = packet_view.frames[cap_id];
+
+                frame_view.frame_status = frame_header.frame_status;
+                frame_view.timestamp = frame_header.timestamp;
+                frame_view.height = frame_header.height;
+                frame_view.width = frame_header.width;
+                memcpy(frame_view.frame_type, frame_header.frame_type, sizeof(frame_view.frame_type));
+                frame_view.frame = NULL;
+                frame_view.motion_vectors = NULL;
+                frame_view.num_mvs = 0;
+
+                // data outside of the slot is never referenced
+                bool in_slot = frame_header.height >= 0 && frame_header.width >= 0 && frame_header.num_mvs >= 0
+                    && frame_header.frame_offset <= this->slot_size
+                    && (uint64_t)frame_header.height * frame_header.width * 3 <= this->slot_size - frame_header.frame_offset
+                    && frame_header.mvs_offset <= this->slot_size
+                    && (uint64_t)frame_header.num_mvs <= (this->slot_size - frame_header.mvs_offset) / (10 * sizeof(MVS_DTYPE));
+
+                if(frame_header.frame_status == FRAME_OKAY && frame_header.frame_offset > 0 && in_slot) {
+                    frame_view.frame = slot_mem + frame_header.frame_offset;
+                    frame_view.motion_vectors = reinterpret_cast<const MVS_DTYPE*>(slot_mem + frame_header.mvs_offset);
+                    frame_view.num_mvs = frame_header.num_mvs;
+                }
+            }
+
+            if(!this->is_valid(packet_view)) {
+                this->num_overruns++;
+                continue;
+            }
+            return true;
+        }
+
+        int wait_ms = -1;
+        if(timeout_ms >= 0) {
+            wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if(wait_ms <= 0)
+                return false;
+        }
+        futex_wait(&this->header->futex_word, futex_value, wait_ms);
+    }
+}
+
+
+bool ShmPacketReader::is_valid(const ShmPacketView& packet_view) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return packet_view.slot->seq.load(std::memory_order_relaxed) == packet_view.seq;
+}
+
+
+uint64_t ShmPacketReader::overruns(void) const {
+    return this->num_overruns;
+}
@@ -0,0 +1,155 @@
+#ifndef SHM_PACKET_RING_H
+#define SHM_PACKET_RING_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "frame_data.hpp"
+
+/*
+*    Memory layout of the POSIX shared memory ring (/dev/shm/<name>)
+*
+*    [ShmRingHeader][slot 0][slot 1]...[slot N-1]
+*
+*    Every slot has a fixed size and holds one frame packet:
+*
+*    [ShmSlotHeader][ShmFrameHeader x num_streams][frame and motion vector data]
+*
+*    Data offsets in ShmFrameHeader are relative to the slot start.
+*
+*/
+
+#define SHM_RING_MAGIC  0x53594e43  // "SYNC"
+#define SHM_RING_VERSION  1
+
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t num_slots;
+    uint64_t slot_size;
+    uint32_t num_streams;
+    std::atomic<uint32_t> futex_word;  // incremented on every publish, readers wait on it
+    std::atomic<uint64_t> write_seq;  // sequence number of the most recently published packet (starts at 1)
+};
+
+struct ShmSlotHeader {
+    std::atomic<uint64_t> seq;  // sequence number of the packet in this slot, 0 while being written
+    double timestamp;  // query timestamp of the frame packet
+    uint32_t num_frames;
+};
+
+struct ShmFrameHeader {
+    int32_t frame_status;
+    double timestamp;
+    int32_t height;
+    int32_t width;
+    char frame_type[2];
+    uint64_t frame_offset;  // 0 if the frame data is not available
+    uint64_t frame_size;
+    uint64_t mvs_offset;
+    int64_t num_mvs;
+};
+
+
+/*
+*    Publishes frame packets into a shared memory ring which can be read
+*    zero-copy by ShmPacketReader instances in other processes
+*
+*/
+
+class ShmPacketWriter {
+
+private:
+
+    std::string shm_name;
+    uint8_t *mem;
+    std::size_t mem_size;
+    ShmRingHeader *header;
+
+    uint8_t *slot_ptr(uint64_t seq);
+
+public:
+
+    /* creates the shared memory object and maps it, an existing object of the
+    same name is unlinked first, so that its readers are never resized */
+    ShmPacketWriter(const std::string& shm_name, std::size_t num_streams,
+        std::size_t num_slots, std::size_t slot_size);
+
+    /* unmaps and unlinks the shared memory object */
+    ~ShmPacketWriter();
+
+    /* copies the frame packet into the next slot and wakes up waiting readers */
+    void publish(const SSFramePacket& frame_packet, double packet_timestamp);
+};
+
+
+/*
+*    Zero-copy view of one frame packet inside the shared memory ring
+*
+*    Pointers reference the mapped ring and stay valid only until the writer
+*    wraps around to the same slot. Use ShmPacketReader::is_valid() after
+*    processing to check that the data has not been overwritten meanwhile.
+*
+*/
+
+struct ShmFrameView {
+    int frame_status;
+    double timestamp;
+    int height;
+    int width;
+    char frame_type[2];
+    const uint8_t *frame;
+    const MVS_DTYPE *motion_vectors;
+    MVS_DTYPE num_mvs;
+};
+
+struct ShmPacketView {
+    uint64_t seq;
+    double timestamp;
+    std::vector<ShmFrameView> frames;
+    const ShmSlotHeader *slot;
+};
+
+
+/*
+*    Reads frame packets published by a ShmPacketWriter in another process
+*
+*/
+
+class ShmPacketReader {
+
+private:
+
+    std::string shm_name;
+    uint8_t *mem;
+    std::size_t mem_size;
+    const ShmRingHeader *header;
+    uint64_t num_slots;  // geometry validated against the mapping when opening
+    uint64_t slot_size;
+    uint32_t num_streams;
+    uint64_t last_seq;
+    uint64_t num_overruns;
+
+public:
+
+    /* opens and maps an existing shared memory ring read-only, throws
+    StreamProcessingError if its geometry does not fit the mapping */
+    ShmPacketReader(const std::string& shm_name);
+
+    /* unmaps the shared memory ring */
+    ~ShmPacketReader();
+
+    /* waits for the next packet, returns false if no packet arrived within
+    timeout_ms milliseconds (timeout_ms < 0 waits forever) */
+    bool next(ShmPacketView& packet_view, int timeout_ms = -1);
+
+    /* returns true if the slot referenced by the view was not overwritten */
+    bool is_valid(const ShmPacketView& packet_view) const;
+
+    /* number of packets which were skipped because the writer overtook the reader */
+    uint64_t overruns(void) const;
+};
+
+#endif
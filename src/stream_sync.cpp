@@ -1,5 +1,15 @@
 #include "stream_sync.hpp"
 
+#include <cerrno>
+#include <limits>
+#include <sys/stat.h>
+
+
+static double unix_time_now(void) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration<double>(now).count();
+}
+
 
 void StreamSynchronizer::open_cams(void) {
     for(std::size_t i = 0; i < this->cams.size(); i++) {
@@ -17,6 +27,8 @@ void StreamSynchronizer::open_cams(void) {
 
 
 void StreamSynchronizer::read_frames(std::size_t cap_id) {
+    apply_thread_config(this->reader_thread_config(cap_id), "ss_read_" + std::to_string(cap_id));
+
     int errors = 0; // for error counting
     //int step = 0; // for simulating breakdown
 
@@ -40,6 +52,7 @@ void StreamSynchronizer::read_frames(std::size_t cap_id) {
 
         // create a single FrameData object for every frame and use a shared pointer for management
         std::shared_ptr<FrameData> frame_data = std::make_shared<FrameData>();
+        (*frame_data).cap_id = (int)cap_id;
 
         bool success = this->caps[cap_id].read(&np_frame, &width, &height, frame_type, &motion_vectors, &num_mvs, &frame_timestamp);
 
@@ -57,11 +70,17 @@ void StreamSynchronizer::read_frames(std::size_t cap_id) {
         else {
             errors = 0;
 
+            // observe the clock of the stream and map the timestamp onto the reference clock
+            double arrival_time = unix_time_now();
+            this->clock_estimators[cap_id]->add(frame_timestamp, arrival_time);
+            if(this->clock_correction)
+                frame_timestamp -= this->clock_correction_at(cap_id, arrival_time);
+
             // Since VideoCap::read allocates new memory for motion_vectors on every
             // call, no copying of the array is required. However, array under np_frame
             // gets reused on every call, so it has to be memcopied to a new buffer here.
             int frame_size = width * height * 3;
-            uint8_t *np_frame_cp = new uint8_t[frame_size];
+            uint8_t *np_frame_cp = (uint8_t*)malloc(frame_size);
             std::copy(np_frame, np_frame+frame_size, np_frame_cp);
 
             (*frame_data).timestamp = frame_timestamp;
@@ -72,10 +91,25 @@ void StreamSynchronizer::read_frames(std::size_t cap_id) {
             (*frame_data).num_mvs = num_mvs;
             strcpy((*frame_data).frame_type, frame_type);
             (*frame_data).frame_status = FRAME_OKAY;
+
+            this->process_motion_vectors(*frame_data);
         }
 
+        // an ingest worker leaves the synchronization to the coordinator
+        if(this->ingest_publisher) {
+            this->ingest_publisher->publish(cap_id, frame_data);
+            if(!this->caps[cap_id].is_valid())
+                this->ingest_publisher->publish_broken(cap_id);
+            continue;
+        }
+
+        // the merged output decides with this whether the stream can still deliver an older frame
+        if(this->merged_output && (*frame_data).frame_status == FRAME_OKAY
+            && (*frame_data).timestamp > this->newest_pushed_timestamps[cap_id])
+            this->newest_pushed_timestamps[cap_id] = (*frame_data).timestamp;
+
         // prevent access to the frame buffer during synchronization
-        this->frame_buffers[cap_id]->push(std::move(frame_data));
+        this->frame_buffers[cap_id]->push_drop_oldest(std::move(frame_data), this->frame_buffer_maxsize);
 
         // notify frame packet generator thread
         this->cv.notify_one();
@@ -90,7 +124,7 @@ int StreamSynchronizer::get_query_timestamp(double& query_timestamp) {
     // lookup the oldest timestamps from all frame buffers
     for(std::size_t cap_id = 0; cap_id < this->frame_buffers.size(); cap_id++) {
 
-        if(!this->caps[cap_id].is_valid()) {
+        if(!this->stream_is_valid(cap_id)) {
             continue;
         }
 
@@ -121,7 +155,7 @@ double StreamSynchronizer::max_stream_offset(void) {
 
         std::shared_ptr<FrameData> buffer_item;
 
-        if(!this->caps[cap_id].is_valid())
+        if(!this->stream_is_valid(cap_id))
             continue;
 
         // check if there is an item at the buffer front (oldest frame) and if so take it's timestamp
@@ -141,13 +175,17 @@ double StreamSynchronizer::max_stream_offset(void) {
 
 std::size_t StreamSynchronizer::min_frame_buffer_size(void) {
     std::vector<std::size_t> sizes;
-    for(std::size_t cap_id = 0; cap_id < this->caps.size(); cap_id++) {
-        if(!this->caps[cap_id].is_valid())
+    for(std::size_t cap_id = 0; cap_id < this->frame_buffers.size(); cap_id++) {
+        if(!this->stream_is_valid(cap_id))
             continue;
 
         sizes.push_back(this->frame_buffers[cap_id]->size());
     }
-    return *std::min_element(sizes.begin(), sizes.end());;
+
+    // once all streams are lost there is nothing left to synchronize
+    if(sizes.empty())
+        return 0;
+    return *std::min_element(sizes.begin(), sizes.end());
 }
 
 
@@ -156,7 +194,7 @@ bool StreamSynchronizer::all_streams_passed_query_time(double query_timestamp) {
         std::shared_ptr<FrameData> frame_data;
 
         // do not consider invalid streams
-        if(!this->caps[cap_id].is_valid())
+        if(!this->stream_is_valid(cap_id))
             continue;
 
         // lookup the most recently pushed item
@@ -172,68 +210,53 @@ bool StreamSynchronizer::all_streams_passed_query_time(double query_timestamp) {
 }
 
 
-SSFramePacket StreamSynchronizer::assemble_frame_packet(double query_timestamp, std::size_t query_cap_id) {
+SSFramePacket StreamSynchronizer::assemble_frame_packet(double query_timestamp) {
 
     SSFramePacket frame_packet;
 
-    // loop over all other frame buffers
+    // the buffer which defined the query timestamp is treated like the others, as its
+    // frame at the query timestamp may have been dropped by the reader meanwhile
     for(std::size_t cap_id = 0; cap_id < this->frame_buffers.size(); cap_id++) {
 
-        std::shared_ptr<FrameData> frame_data_tmp;
-        std::shared_ptr<FrameData> frame_data = std::make_shared<FrameData>();
-        // initialize pointers so free below is well-defined on first iteration
-        (*frame_data).frame = NULL;
-        (*frame_data).motion_vectors = NULL;
+        std::shared_ptr<FrameData> frame_data;
 
         // if cap is broken do not consider it during synchronization
-        if(!this->caps[cap_id].is_valid()) {
+        if(!this->stream_is_valid(cap_id)) {
+            frame_data = std::make_shared<FrameData>();
             (*frame_data).frame_status = CAP_BROKEN;
             frame_packet.push_back(std::move(frame_data));
             continue;
         }
 
-        // for the input buffer with the most recent timestamp simply get the rightmost frame
-        if(cap_id == query_cap_id) {
-            this->frame_buffers[cap_id]->pop(frame_data);
-            frame_packet.push_back(std::move(frame_data));
-            continue;
+        // take the newest valid frame up to the query timestamp, older ones are counted as dropped
+        // (the "=" is important in case the timestamp is identical to the query timestamp)
+        this->frame_buffers[cap_id]->pop_while(frame_data, [query_timestamp](const std::shared_ptr<FrameData>& item) {
+            return ((*item).frame_status == FRAME_OKAY && (*item).timestamp <= query_timestamp);
+        });
+
+        // if the next frame is invalid it has no timestamp for synchronization,
+        // so just remove it from the buffer and pass it on if no valid frame matched
+        std::shared_ptr<FrameData> invalid_frame_data;
+        bool invalid = this->frame_buffers[cap_id]->pop_if(invalid_frame_data, [](const std::shared_ptr<FrameData>& item) {
+            return ((*item).frame_status != FRAME_OKAY);
+        });
+        if(invalid && !frame_data)
+            frame_data = std::move(invalid_frame_data);
+
+        // buffer holds only newer frames
+        if(!frame_data) {
+            frame_data = std::make_shared<FrameData>();
+            (*frame_data).frame_status = FRAME_DROPPED;
         }
 
-        while(1) {
-            // try to read out the front item
-            if(!this->frame_buffers[cap_id]->front(frame_data_tmp)) {
-                (*frame_data).frame_status = FRAME_DROPPED;
-                frame_packet.push_back(std::move(frame_data));
-                break;
-            }
-
-            // if the frame is invalid it has no timestamp for
-            // synchronization, so just remove it from the buffer
-            if((*frame_data_tmp).frame_status != FRAME_OKAY) {
-                this->frame_buffers[cap_id]->pop();
-                break;
-            }
-
-            // if the frame is valid remove items from the buffer until it's timestamp matches the query timestamp
-            if((*frame_data_tmp).timestamp <= query_timestamp) { // the "=" is important in case the timestamp is identical to the query timestamp
-                // free memory of frame_data from previous iteration
-                free((*frame_data).frame);
-                free((*frame_data).motion_vectors);
-                this->frame_buffers[cap_id]->pop();  // remove item from the input buffer and free memory
-                frame_data = std::move(frame_data_tmp);
-            }
-            else {
-                frame_packet.push_back(std::move(frame_data));
-                break;
-            }
-        }
+        frame_packet.push_back(std::move(frame_data));
     }
 
     return frame_packet;
 }
 
 
-void StreamSynchronizer::generate_frame_packets(void) {
+void StreamSynchronizer::wait_for_streams(void) {
 
     // wait until every (valid) buffer has at least one frame stored
     std::cout << "Waiting for buffers to fill up... ";
@@ -264,6 +287,14 @@ void StreamSynchronizer::generate_frame_packets(void) {
         std::cout << "(relative offset " << max_offset
                   << " seconds) [OK]" << std::endl;
     }
+}
+
+
+void StreamSynchronizer::generate_frame_packets(void) {
+
+    apply_thread_config(this->sync_thread_config, "ss_sync");
+
+    this->wait_for_streams();
 
     // continuously generate new synchronized frame packets and put them in the output buffer
     while(1) {
@@ -285,7 +316,7 @@ void StreamSynchronizer::generate_frame_packets(void) {
 
         // get most recent of all oldest timestamps (the timestamps on the buffer front)
         double query_timestamp;
-        std::size_t query_cap_id = this->get_query_timestamp(query_timestamp);
+        this->get_query_timestamp(query_timestamp);
 
         // wait until each queue has passed this timepoint (queue back has this or a newer timestamp)
         lk.lock();
@@ -293,13 +324,242 @@ void StreamSynchronizer::generate_frame_packets(void) {
         lk.unlock();
 
         // now pop all older timestamps up to this timepoint from the buffers and put frame data into a packet
-        SSFramePacket frame_packet = this->assemble_frame_packet(query_timestamp, query_cap_id);
+        SSFramePacket frame_packet = this->assemble_frame_packet(query_timestamp);
+
+        this->output_frame_packet(frame_packet, query_timestamp, false);
+    }
+}
+
+
+void StreamSynchronizer::merge_frames(void) {
 
+    apply_thread_config(this->sync_thread_config, "ss_merge");
+
+    this->wait_for_streams();
+
+    // the oldest frame of every stream is taken out of its buffer and kept in
+    // a min-heap ordered by timestamp, frames without timestamp sort first
+    typedef std::pair<double, std::size_t> MergeItem;  // (timestamp, cap_id)
+    std::priority_queue<MergeItem, std::vector<MergeItem>, std::greater<MergeItem> > heap;
+    std::size_t num_streams = this->frame_buffers.size();
+    std::vector<std::shared_ptr<FrameData> > heads(num_streams);
+    std::vector<double> pushed_timestamps(num_streams);
+
+    double newest_timestamp = -std::numeric_limits<double>::infinity();  // newest timestamp pushed by any stream
+    double last_timestamp = -std::numeric_limits<double>::infinity();  // timestamp of the last frame passed on
+
+    // moves the next frame of a stream into the heap, returns false if its buffer is empty
+    auto take_head = [&](std::size_t cap_id) {
+        if(!this->frame_buffers[cap_id]->try_pop(heads[cap_id]))
+            return false;
+        double timestamp = -std::numeric_limits<double>::infinity();
+        if((*heads[cap_id]).frame_status == FRAME_OKAY)
+            timestamp = (*heads[cap_id]).timestamp;
+        heap.push(std::make_pair(timestamp, cap_id));
+        return true;
+    };
+
+    while(1) {
+
+        // pass on frames as long as no stream can deliver an older one in time
+        while(1) {
+            // the pushed timestamps are read before the buffers, so that an empty buffer
+            // means the stream has no frame older than its pushed timestamp left
+            for(std::size_t cap_id = 0; cap_id < num_streams; cap_id++) {
+                pushed_timestamps[cap_id] = this->newest_pushed_timestamps[cap_id];
+                newest_timestamp = std::max(newest_timestamp, pushed_timestamps[cap_id]);
+            }
+            for(std::size_t cap_id = 0; cap_id < num_streams; cap_id++) {
+                if(!heads[cap_id])
+                    take_head(cap_id);
+            }
+            if(heap.empty())
+                break;
+
+            // streams lagging more than the reorder window behind the newest frame are not waited for
+            MergeItem item = heap.top();
+            bool waiting = false;
+            for(std::size_t cap_id = 0; cap_id < num_streams; cap_id++) {
+                if(!heads[cap_id] && this->stream_is_valid(cap_id) && pushed_timestamps[cap_id] < item.first)
+                    waiting = true;
+            }
+            if(waiting && item.first > newest_timestamp - this->merge_reorder_window)
+                break;
+            heap.pop();
+
+            std::size_t cap_id = item.second;
+            if((*heads[cap_id]).frame_status == FRAME_OKAY) {
+                if(item.first < last_timestamp)
+                    this->merge_late_frames++;
+                last_timestamp = std::max(last_timestamp, item.first);
+            }
+
+            SSFramePacket frame_packet;
+            frame_packet.push_back(std::move(heads[cap_id]));
+            heads[cap_id].reset();
+            this->merged_frame_buffer->push_wait(std::move(frame_packet));
+        }
+
+        // wait until a missing stream delivers or any stream pushes a newer frame,
+        // which may let the oldest frame pass, or re-check broken streams after a timeout
+        std::unique_lock<std::mutex> lk(this->frame_buffer_mutex);
+        this->cv.wait_for(lk, std::chrono::milliseconds(100), [this, &heads, newest_timestamp, num_streams]{
+            for(std::size_t cap_id = 0; cap_id < num_streams; cap_id++) {
+                if(!heads[cap_id] && this->frame_buffers[cap_id]->size() > 0)
+                    return true;
+                if(this->newest_pushed_timestamps[cap_id] > newest_timestamp)
+                    return true;
+            }
+            return false;
+        });
+    }
+}
+
+
+void StreamSynchronizer::output_frame_packet(SSFramePacket& frame_packet, double packet_timestamp, bool block_if_full) {
+
+    // workers keep the matched frames for fetching and release the skipped ones
+    if(this->coordinator_server)
+        this->coordinator_server->send_matches(frame_packet);
+
+    if(this->motion_gate_threshold > 0 && !this->gate_frame_packet(frame_packet))
+        return;
+
+    // preprocessing and mosaic are handed off to the processing thread
+    if(this->worker_pool) {
+        this->queue_frame_packet(std::move(frame_packet), packet_timestamp, block_if_full);
+        return;
+    }
+
+    this->deliver_frame_packet(frame_packet, packet_timestamp, block_if_full);
+}
+
+
+void StreamSynchronizer::deliver_frame_packet(SSFramePacket& frame_packet, double packet_timestamp, bool block_if_full) {
+
+    if(this->history)
+        this->history->push(packet_timestamp, frame_packet);
+
+    if(this->shm_writer)
+        this->shm_writer->publish(frame_packet, packet_timestamp);
+
+    if(this->recording_writer)
+        this->recording_writer->write(frame_packet, packet_timestamp);
+
+    // registered callbacks replace the output buffer
+    if(this->dispatcher->num_callbacks() > 0)
+        this->dispatcher->dispatch(frame_packet, block_if_full || this->output_policy == OUTPUT_LOSSLESS);
+    else if(block_if_full || this->output_policy == OUTPUT_LOSSLESS)
+        this->frame_packet_buffer->push_wait(std::move(frame_packet));
+    else
         this->frame_packet_buffer->push(std::move(frame_packet));
+}
+
+
+void StreamSynchronizer::queue_frame_packet(SSFramePacket&& frame_packet, double packet_timestamp, bool block_if_full) {
+    std::unique_lock<std::mutex> lk(this->process_mutex);
+
+    if(this->process_queue.size() >= this->process_queue_maxsize) {
+        if(block_if_full || this->output_policy == OUTPUT_LOSSLESS) {
+            auto start = std::chrono::steady_clock::now();
+            this->process_cond.wait(lk, [this]{return (this->process_queue.size() < this->process_queue_maxsize);});
+            this->process_blocked_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        else {
+            // processing can not keep up, the oldest packet is outdated anyway
+            this->process_queue.pop_front();
+            this->process_dropped_packets++;
+        }
+    }
+
+    this->process_queue.push_back({std::move(frame_packet), packet_timestamp, block_if_full});
+    lk.unlock();
+    this->process_cond.notify_all();
+}
+
+
+void StreamSynchronizer::process_frame_packets(void) {
+
+    // placed like the workers (see create_outputs)
+    ThreadConfig process_config = this->sync_thread_config;
+    process_config.realtime_priority = 0;
+    apply_thread_config(process_config, "ss_process");
+
+    bool preprocessing = this->preprocessing_config.width > 0 && this->preprocessing_config.height > 0;
+
+    while(1) {
+        std::unique_lock<std::mutex> lk(this->process_mutex);
+        this->process_cond.wait(lk, [this]{return !this->process_queue.empty();});
+        ProcessItem item = std::move(this->process_queue.front());
+        this->process_queue.pop_front();
+        lk.unlock();
+        this->process_cond.notify_all();
+
+        // the end marker of a replay follows the last packet
+        if(item.frame_packet.empty()) {
+            this->frame_packet_buffer->push_wait(std::move(item.frame_packet));
+            continue;
+        }
+
+        if(preprocessing)
+            this->preprocess_frame_packet(item.frame_packet);
+
+        if(this->mosaic_renderer) {
+            std::shared_ptr<PacketMosaic> mosaic = this->mosaic_renderer->render(item.frame_packet,
+                item.packet_timestamp, *this->worker_pool);
+            for(std::size_t cap_id = 0; cap_id < item.frame_packet.size(); cap_id++) {
+                item.frame_packet[cap_id]->mosaic = mosaic;
+            }
+        }
+
+        this->deliver_frame_packet(item.frame_packet, item.packet_timestamp, item.block_if_full);
     }
 }
 
 
+void StreamSynchronizer::replay_frame_packets(void) {
+
+    apply_thread_config(this->sync_thread_config, "ss_replay");
+
+    std::size_t num_packets = this->replay_reader->size();
+    std::cout << "Replaying " << num_packets << " frame packets." << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(std::size_t i = 0; i < num_packets; i++) {
+        double packet_timestamp = this->replay_reader->timestamp(i);
+
+        // reproduce the recorded packet rate
+        if(this->replay_paced) {
+            double t = packet_timestamp - this->replay_reader->timestamp(0);
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(t)));
+        }
+
+        SSFramePacket frame_packet;
+        try {
+            this->replay_reader->read(i, frame_packet);
+        }
+        catch(const StreamProcessingError& e) {
+            std::cerr << e.what() << std::endl;
+            break;
+        }
+        for(std::size_t cap_id = 0; cap_id < frame_packet.size(); cap_id++) {
+            if(frame_packet[cap_id]->frame_status == FRAME_OKAY)
+                this->process_motion_vectors(*frame_packet[cap_id]);
+        }
+        this->output_frame_packet(frame_packet, packet_timestamp, !this->replay_paced);
+    }
+
+    // an empty frame packet signals the end of the recording
+    std::cout << "Replay finished." << std::endl;
+    if(this->worker_pool)
+        this->queue_frame_packet(SSFramePacket(), 0, true);
+    else
+        this->frame_packet_buffer->push_wait(SSFramePacket());
+}
+
+
 StreamSynchronizer::StreamSynchronizer(std::vector<const char*> cams,
     double max_initial_stream_offset,
     int max_read_errors,
@@ -328,6 +588,15 @@ void StreamSynchronizer::init(std::vector<const char*> cams,
     int max_read_errors,
     int frame_packet_buffer_maxsize) {
 
+    // frames dropped from a full frame buffer would be missing in the merged output
+    if(this->merged_output && this->frame_buffer_maxsize > 0)
+        throw StreamProcessingError("The merged output does not support a frame buffer maxsize");
+
+    // validated before any thread is started, which could not be stopped on error
+    if(this->clock_correction && this->clock_reference >= (int)cams.size())
+        throw StreamProcessingError("Clock reference " + std::to_string(this->clock_reference)
+            + " is not a stream");
+
     this->cams = cams;
     this->max_initial_stream_offset = max_initial_stream_offset;
     this->max_read_errors = max_read_errors;
@@ -336,11 +605,51 @@ void StreamSynchronizer::init(std::vector<const char*> cams,
 
     this->open_cams();
 
+    this->create_outputs(this->caps.size());
+
+    // open a packet recorder for every stream which could be opened for decoding
+    if(this->packet_ring_duration > 0 || this->packet_ring_max_bytes > 0) {
+        for(std::size_t i = 0; i < this->caps.size(); i++) {
+            std::unique_ptr<EncodedPacketRecorder> recorder;
+            if(this->caps[i].is_valid()) {
+                try {
+                    recorder = std::make_unique<EncodedPacketRecorder>(this->cams[i],
+                        this->packet_ring_duration, this->packet_ring_max_bytes,
+                        this->reader_thread_config(i), "ss_pktring_" + std::to_string(i));
+                }
+                catch(const StreamProcessingError& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+            }
+            this->packet_recorders.push_back(std::move(recorder));
+        }
+    }
+
+    for(std::size_t i = 0; i < this->caps.size(); i++) {
+        this->clock_estimators.push_back(std::make_unique<ClockEstimator>(this->clock_window));
+        this->clock_corrections.push_back(0);
+        this->clock_correction_times.push_back(unix_time_now());
+    }
+
     // create frame buffers
     for(std::size_t i = 0; i < this->caps.size(); i++) {
         std::unique_ptr<SharedQueue<std::shared_ptr<FrameData> > > frame_buffer = std::make_unique<SharedQueue<std::shared_ptr<FrameData> > >();
         this->frame_buffers.push_back(std::move(frame_buffer));
     }
+    this->newest_pushed_timestamps.reset(new std::atomic<double>[this->caps.size()]);
+    for(std::size_t i = 0; i < this->caps.size(); i++) {
+        this->newest_pushed_timestamps[i] = -std::numeric_limits<double>::infinity();
+    }
+
+    if(!this->coordinator_address.empty()) {
+        this->ingest_publisher = std::make_unique<IngestPublisher>(this->coordinator_address,
+            this->ingest_worker_id, this->caps.size(), this->ingest_max_pending_frames,
+            this->ingest_max_matched_frames);
+        for(std::size_t i = 0; i < this->caps.size(); i++) {
+            if(!this->caps[i].is_valid())
+                this->ingest_publisher->publish_broken(i);
+        }
+    }
 
     // start background threads to read frames into frame buffers
     for(std::size_t i = 0; i < this->caps.size(); i++) {
@@ -349,13 +658,511 @@ void StreamSynchronizer::init(std::vector<const char*> cams,
         );
     }
 
-    // start background thread to generate synchronized frame packets
+    // start background thread to generate synchronized frame packets (or the merged frame stream)
+    if(this->ingest_publisher) {
+        return;
+    }
+    else if(this->merged_output) {
+        this->merged_frame_buffer = std::make_unique<FramePacketDeque>(this->merged_frame_buffer_maxsize);
+        this->threads.push_back(
+            std::thread(&StreamSynchronizer::merge_frames, this)
+        );
+    }
+    else {
+        this->threads.push_back(
+            std::thread(&StreamSynchronizer::generate_frame_packets, this)
+        );
+    }
+}
+
+
+void StreamSynchronizer::create_outputs(std::size_t num_streams) {
+
+    if(this->history_max_packets > 0 || this->history_max_bytes > 0) {
+        this->history = std::make_unique<FramePacketHistory>(this->history_max_packets,
+            this->history_max_bytes);
+    }
+
+    if(!this->shm_name.empty()) {
+        this->shm_writer = std::make_unique<ShmPacketWriter>(this->shm_name,
+            num_streams, this->shm_num_slots, this->shm_slot_size);
+    }
+
+    if(!this->recording_path.empty()) {
+        // the writer serves the synchronization thread, so it shares its placement
+        ThreadConfig writer_config = this->sync_thread_config;
+        writer_config.realtime_priority = 0;
+        this->recording_writer = std::make_unique<PacketRecordingWriter>(this->recording_path,
+            num_streams, 16, writer_config);
+    }
+
+    // preprocessing and mosaic share one pool of workers
+    bool preprocessing = this->preprocessing_config.width > 0 && this->preprocessing_config.height > 0;
+    bool mosaic = this->mosaic_config.tile_width > 0 && this->mosaic_config.tile_height > 0;
+    if(preprocessing || mosaic) {
+        std::size_t num_threads = 0;
+        if(preprocessing)
+            num_threads = std::max(num_threads, this->preprocessing_config.num_threads);
+        if(mosaic) {
+            num_threads = std::max(num_threads, this->mosaic_config.num_threads);
+            this->mosaic_renderer = std::make_unique<MosaicRenderer>(this->mosaic_config, num_streams);
+        }
+
+        // workers and processing thread take over work from the synchronization thread, so they share
+        // its placement, but not its real-time priority, which would let them starve it
+        ThreadConfig pool_config = this->sync_thread_config;
+        pool_config.realtime_priority = 0;
+        this->worker_pool = std::make_unique<WorkerPool>(num_threads, pool_config, "ss_worker");
+
+        this->threads.push_back(
+            std::thread(&StreamSynchronizer::process_frame_packets, this)
+        );
+    }
+
+    this->create_dispatcher();
+}
+
+
+void StreamSynchronizer::init_replay(const std::string& path,
+    bool paced,
+    int frame_packet_buffer_maxsize) {
+
+    this->replay_paced = paced;
+    this->replay_reader = std::make_unique<PacketRecordingReader>(path);
+
+    this->frame_packet_buffer = std::make_unique<FramePacketDeque>(frame_packet_buffer_maxsize);
+
+    this->create_outputs(this->replay_reader->num_streams());
+
+    // start background thread to read frame packets from the recording
+    this->threads.push_back(
+        std::thread(&StreamSynchronizer::replay_frame_packets, this)
+    );
+}
+
+
+void StreamSynchronizer::enable_ingest_worker(const std::string& coordinator_address, int worker_id,
+    std::size_t max_pending_frames, std::size_t max_matched_frames) {
+    this->coordinator_address = coordinator_address;
+    this->ingest_worker_id = worker_id;
+    this->ingest_max_pending_frames = max_pending_frames;
+    this->ingest_max_matched_frames = max_matched_frames;
+}
+
+
+void StreamSynchronizer::init_coordinator(int port,
+    std::size_t num_workers,
+    double max_initial_stream_offset,
+    int frame_packet_buffer_maxsize) {
+
+    // packets of the coordinator contain no frame data to process or store
+    if(!this->shm_name.empty() || !this->recording_path.empty() || this->merged_output
+        || this->motion_gate_threshold > 0
+        || (this->preprocessing_config.width > 0 && this->preprocessing_config.height > 0)
+        || (this->mosaic_config.tile_width > 0 && this->mosaic_config.tile_height > 0))
+        throw StreamProcessingError("Shared memory output, recording, merged output, motion gate, "
+            "preprocessing and mosaic are not supported by the coordinator");
+
+    this->max_initial_stream_offset = max_initial_stream_offset;
+    this->frame_packet_buffer = std::make_unique<FramePacketDeque>(frame_packet_buffer_maxsize);
+
+    this->coordinator_server = std::make_unique<CoordinatorServer>(port, num_workers);
+    std::size_t num_streams = this->coordinator_server->num_streams();
+    if(num_streams == 0)
+        throw StreamProcessingError("The ingest workers have no streams");
+
+    this->create_outputs(num_streams);
+
+    for(std::size_t i = 0; i < num_streams; i++) {
+        this->frame_buffers.push_back(std::make_unique<SharedQueue<std::shared_ptr<FrameData> > >());
+    }
+
+    // metadata received from the workers takes the place of the reader threads
+    ThreadConfig receiver_config = this->sync_thread_config;
+    receiver_config.realtime_priority = 0;
+    this->coordinator_server->start([this](std::shared_ptr<FrameData> frame_data) {
+        if((*frame_data).frame_status != CAP_BROKEN)
+            this->frame_buffers[(*frame_data).cap_id]->push_drop_oldest(std::move(frame_data), this->frame_buffer_maxsize);
+        this->cv.notify_one();
+    }, receiver_config);
+
     this->threads.push_back(
         std::thread(&StreamSynchronizer::generate_frame_packets, this)
     );
 }
 
 
+void StreamSynchronizer::fetch_frames(const SSFramePacket& frame_packet, SSFramePacket& fetched) {
+    if(!this->coordinator_server)
+        throw StreamProcessingError("Frames can only be fetched by a coordinator");
+    this->coordinator_server->fetch(frame_packet, fetched);
+}
+
+
+bool StreamSynchronizer::stream_is_valid(std::size_t cap_id) {
+    if(this->coordinator_server)
+        return this->coordinator_server->stream_is_valid(cap_id);
+    return this->caps[cap_id].is_valid();
+}
+
+
+void StreamSynchronizer::enable_recording(const std::string& path) {
+    this->recording_path = path;
+}
+
+
+void StreamSynchronizer::enable_history(std::size_t max_packets, std::size_t max_bytes) {
+    this->history_max_packets = max_packets;
+    this->history_max_bytes = max_bytes;
+}
+
+
+bool StreamSynchronizer::get_packet_at(double timestamp, SSFramePacket& frame_packet, double& packet_timestamp) {
+    if(!this->history)
+        return false;
+    return this->history->get_packet_at(timestamp, frame_packet, packet_timestamp);
+}
+
+
+void StreamSynchronizer::get_packets_between(double timestamp0, double timestamp1,
+    std::vector<SSFramePacket>& frame_packets, std::vector<double>& packet_timestamps) {
+    frame_packets.clear();
+    packet_timestamps.clear();
+    if(this->history)
+        this->history->get_packets_between(timestamp0, timestamp1, frame_packets, packet_timestamps);
+}
+
+
+void StreamSynchronizer::enable_packet_ring(double max_duration, std::size_t max_bytes) {
+    this->packet_ring_duration = max_duration;
+    this->packet_ring_max_bytes = max_bytes;
+}
+
+
+std::vector<ExportedClip> StreamSynchronizer::export_clip(double timestamp0, double timestamp1, const std::string& directory) {
+
+    std::vector<ExportedClip> clips;
+
+    if(mkdir(directory.c_str(), 0755) < 0 && errno != EEXIST)
+        throw StreamProcessingError("Could not create clip directory " + directory);
+
+    for(std::size_t cap_id = 0; cap_id < this->packet_recorders.size(); cap_id++) {
+        if(!this->packet_recorders[cap_id])
+            continue;
+
+        std::stringstream path;
+        path << directory << "/stream_" << cap_id << ".mp4";
+        double clip_timestamp;
+        if(this->packet_recorders[cap_id]->export_clip(timestamp0, timestamp1, path.str(), clip_timestamp))
+            clips.push_back({cap_id, path.str(), clip_timestamp});
+    }
+
+    return clips;
+}
+
+
+void StreamSynchronizer::enable_shm_output(const std::string& shm_name,
+    std::size_t num_slots,
+    std::size_t slot_size) {
+
+    this->shm_name = shm_name;
+    this->shm_num_slots = num_slots;
+    this->shm_slot_size = slot_size;
+}
+
+
+void StreamSynchronizer::create_dispatcher(void) {
+    std::lock_guard<std::mutex> lock(this->dispatcher_mutex);
+    if(!this->dispatcher)
+        this->dispatcher = std::make_unique<PacketDispatcher>(this->num_dispatcher_threads,
+            this->dispatcher_thread_config);
+}
+
+
+void StreamSynchronizer::set_dispatcher_threads(std::size_t num_threads) {
+    this->num_dispatcher_threads = num_threads;
+}
+
+
+void StreamSynchronizer::process_motion_vectors(FrameData& frame_data) {
+
+    if(this->motion_vector_config.filter_zero)
+        frame_data.num_mvs = filter_zero_motion_vectors(frame_data.motion_vectors, frame_data.num_mvs);
+
+    if(this->motion_vector_config.compact) {
+        std::size_t size = (std::size_t)frame_data.num_mvs * MVS_COMPACT_COLUMNS * sizeof(float);
+        frame_data.compact_motion_vectors = (float*)malloc(std::max(size, sizeof(float)));
+        compact_motion_vectors(frame_data.motion_vectors, frame_data.num_mvs, frame_data.compact_motion_vectors);
+    }
+
+    if(this->motion_gate_threshold > 0)
+        frame_data.motion_score = motion_score(frame_data.motion_vectors, frame_data.num_mvs,
+            frame_data.height, frame_data.width);
+
+    if(this->motion_vector_config.grid) {
+        motion_grid_size(frame_data.height, frame_data.width, frame_data.grid_height, frame_data.grid_width);
+        std::size_t size = (std::size_t)frame_data.grid_height * frame_data.grid_width * 2 * sizeof(float);
+        frame_data.motion_grid = (float*)malloc(std::max(size, sizeof(float)));
+        rasterize_motion_vectors(frame_data.motion_vectors, frame_data.num_mvs,
+            frame_data.grid_height, frame_data.grid_width, frame_data.motion_grid);
+    }
+}
+
+
+void StreamSynchronizer::set_motion_vector_config(const MotionVectorConfig& config) {
+    this->motion_vector_config = config;
+}
+
+
+void StreamSynchronizer::preprocess_frame_packet(SSFramePacket& frame_packet) {
+
+    std::shared_ptr<PacketTensor> tensor = std::make_shared<PacketTensor>();
+    (*tensor).batch = frame_packet.size();
+    (*tensor).height = this->preprocessing_config.height;
+    (*tensor).width = this->preprocessing_config.width;
+    (*tensor).nchw = this->preprocessing_config.nchw;
+    std::size_t size = (*tensor).batch * (*tensor).slice_size() * sizeof(float);
+    (*tensor).data = (float*)malloc(std::max(size, sizeof(float)));
+    if(!(*tensor).data)
+        throw StreamProcessingError("Could not allocate the frame packet tensor.");
+
+    // one iteration per frame, each writes its own slice
+    this->worker_pool->parallel_for(frame_packet.size(), [&](std::size_t cap_id) {
+        float *slice = (*tensor).data + cap_id * (*tensor).slice_size();
+        if(frame_packet[cap_id]->frame_status == FRAME_OKAY)
+            preprocess_frame(*frame_packet[cap_id], this->preprocessing_config, slice);
+        else
+            std::fill(slice, slice + (*tensor).slice_size(), 0.0f);
+    });
+
+    for(std::size_t cap_id = 0; cap_id < frame_packet.size(); cap_id++) {
+        frame_packet[cap_id]->tensor = tensor;
+    }
+}
+
+
+void StreamSynchronizer::enable_preprocessing(const PreprocessingConfig& config) {
+    this->preprocessing_config = config;
+}
+
+
+void StreamSynchronizer::enable_mosaic(const MosaicConfig& config) {
+    this->mosaic_config = config;
+}
+
+
+bool StreamSynchronizer::gate_frame_packet(SSFramePacket& frame_packet) {
+
+    std::lock_guard<std::mutex> lock(this->gate_mutex);
+
+    if(this->gate_last_score.size() < frame_packet.size()) {
+        this->gate_last_score.resize(frame_packet.size(), 0);
+        this->gate_last_emitted.resize(frame_packet.size(), -std::numeric_limits<double>::infinity());
+        this->gate_unchanged_frames.resize(frame_packet.size(), 0);
+    }
+
+    bool any_valid = false;
+    bool any_changed = false;
+
+    for(std::size_t cap_id = 0; cap_id < frame_packet.size(); cap_id++) {
+        const FrameData& frame_data = *frame_packet[cap_id];
+        if(frame_data.frame_status != FRAME_OKAY)
+            continue;
+        any_valid = true;
+
+        double score = frame_data.motion_score;
+        if(frame_data.frame_type[0] == 'I')
+            score = this->gate_last_score[cap_id];
+        this->gate_last_score[cap_id] = score;
+
+        bool first = std::isinf(this->gate_last_emitted[cap_id]);
+        bool refresh = (this->motion_gate_max_interval > 0) &&
+            (frame_data.timestamp - this->gate_last_emitted[cap_id] >= this->motion_gate_max_interval);
+        if(first || refresh || score >= this->motion_gate_threshold) {
+            this->gate_last_emitted[cap_id] = frame_data.timestamp;
+            any_changed = true;
+            continue;
+        }
+
+        // the frame buffers are released once no other output references them
+        std::shared_ptr<FrameData> unchanged = std::make_shared<FrameData>();
+        (*unchanged).timestamp = frame_data.timestamp;
+        strcpy((*unchanged).frame_type, frame_data.frame_type);
+        (*unchanged).motion_score = score;
+        (*unchanged).frame_status = FRAME_UNCHANGED;
+        frame_packet[cap_id] = std::move(unchanged);
+        this->gate_unchanged_frames[cap_id]++;
+    }
+
+    if(this->motion_gate_suppress && any_valid && !any_changed) {
+        this->gate_suppressed_packets++;
+        return false;
+    }
+
+    return true;
+}
+
+
+void StreamSynchronizer::enable_motion_gate(double threshold, bool suppress, double max_interval) {
+    this->motion_gate_threshold = threshold;
+    this->motion_gate_suppress = suppress;
+    this->motion_gate_max_interval = max_interval;
+}
+
+
+void StreamSynchronizer::set_output_policy(int policy) {
+    if(policy != OUTPUT_LATEST && policy != OUTPUT_LOSSLESS)
+        throw StreamProcessingError("Unknown output policy " + std::to_string(policy));
+    this->output_policy = policy;
+}
+
+
+void StreamSynchronizer::set_frame_buffer_maxsize(std::size_t maxsize) {
+    this->frame_buffer_maxsize = maxsize;
+}
+
+
+void StreamSynchronizer::get_output_stats(OutputStats& stats) {
+    stats.dropped_packets = 0;
+    stats.blocked_time = 0;
+    if(this->frame_packet_buffer) {
+        stats.dropped_packets = this->frame_packet_buffer->num_dropped();
+        stats.blocked_time = this->frame_packet_buffer->time_blocked();
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->process_mutex);
+        stats.dropped_packets += this->process_dropped_packets;
+        stats.blocked_time += this->process_blocked_time;
+    }
+    if(this->merged_frame_buffer)
+        stats.blocked_time += this->merged_frame_buffer->time_blocked();
+    {
+        std::lock_guard<std::mutex> lock(this->dispatcher_mutex);
+        if(this->dispatcher)
+            stats.blocked_time += this->dispatcher->time_blocked();
+    }
+    stats.dropped_frames.clear();
+    for(std::size_t cap_id = 0; cap_id < this->frame_buffers.size(); cap_id++) {
+        stats.dropped_frames.push_back(this->frame_buffers[cap_id]->num_dropped());
+    }
+    std::lock_guard<std::mutex> lock(this->gate_mutex);
+    stats.suppressed_packets = this->gate_suppressed_packets;
+    stats.unchanged_frames = this->gate_unchanged_frames;
+    stats.late_frames = this->merge_late_frames;
+}
+
+
+double StreamSynchronizer::clock_correction_at(std::size_t cap_id, double arrival_time) {
+    // nothing is corrected until the estimates of the stream and the reference are valid
+    double target = 0;
+    double change, reference_change;
+    if(this->clock_estimators[cap_id]->offset_change(arrival_time, change)) {
+        if(this->clock_reference == CLOCK_HOST_REFERENCE)
+            target = change;
+        else if(this->clock_estimators[this->clock_reference]->offset_change(arrival_time, reference_change))
+            target = change - reference_change;
+    }
+
+    // follow refits of the estimate slowly instead of jumping
+    std::lock_guard<std::mutex> lock(this->clock_mutex);
+    double& correction = this->clock_corrections[cap_id];
+    double max_step = CLOCK_CORRECTION_MAX_RATE * std::max(arrival_time - this->clock_correction_times[cap_id], 0.0);
+    correction += std::min(std::max(target - correction, -max_step), max_step);
+    this->clock_correction_times[cap_id] = arrival_time;
+    return correction;
+}
+
+
+void StreamSynchronizer::enable_clock_correction(int reference, double window) {
+    if(reference < CLOCK_HOST_REFERENCE)
+        throw StreamProcessingError("Invalid clock reference " + std::to_string(reference));
+    this->clock_correction = true;
+    this->clock_reference = reference;
+    this->clock_window = window;
+}
+
+
+void StreamSynchronizer::enable_merged_output(double reorder_window, std::size_t buffer_maxsize) {
+    this->merged_output = true;
+    this->merge_reorder_window = reorder_window;
+    this->merged_frame_buffer_maxsize = buffer_maxsize;
+}
+
+
+std::shared_ptr<FrameData> StreamSynchronizer::get_next_frame(void) {
+    if(!this->merged_frame_buffer)
+        throw StreamProcessingError("The merged output is not enabled");
+    return this->merged_frame_buffer->pop()[0];
+}
+
+
+void StreamSynchronizer::get_clock_estimates(std::vector<ClockEstimate>& estimates) {
+    estimates.clear();
+    for(std::size_t cap_id = 0; cap_id < this->clock_estimators.size(); cap_id++) {
+        ClockEstimate estimate = this->clock_estimators[cap_id]->estimate();
+        if(this->clock_correction) {
+            std::lock_guard<std::mutex> lock(this->clock_mutex);
+            estimate.correction = this->clock_corrections[cap_id];
+        }
+        estimates.push_back(estimate);
+    }
+}
+
+
+void StreamSynchronizer::set_reader_thread_config(std::size_t cap_id, const ThreadConfig& config) {
+    if(this->reader_thread_configs.size() <= cap_id)
+        this->reader_thread_configs.resize(cap_id + 1);
+    this->reader_thread_configs[cap_id] = config;
+}
+
+
+ThreadConfig StreamSynchronizer::reader_thread_config(std::size_t cap_id) {
+    if(cap_id < this->reader_thread_configs.size())
+        return this->reader_thread_configs[cap_id];
+    return ThreadConfig();
+}
+
+
+void StreamSynchronizer::set_sync_thread_config(const ThreadConfig& config) {
+    this->sync_thread_config = config;
+}
+
+
+void StreamSynchronizer::set_dispatcher_thread_config(const ThreadConfig& config) {
+    this->dispatcher_thread_config = config;
+}
+
+
+int StreamSynchronizer::register_callback(SSFramePacketCallback callback, std::size_t max_pending) {
+    this->create_dispatcher();
+    return this->dispatcher->add_callback(callback, max_pending);
+}
+
+
+bool StreamSynchronizer::unregister_callback(int callback_id) {
+    if(!this->dispatcher)
+        return false;
+    return this->dispatcher->remove_callback(callback_id);
+}
+
+
+bool StreamSynchronizer::get_callback_stats(int callback_id, CallbackStats& stats) {
+    if(!this->dispatcher)
+        return false;
+    return this->dispatcher->get_stats(callback_id, stats);
+}
+
+
 SSFramePacket StreamSynchronizer::get_frame_packet(void) {
     return this->frame_packet_buffer->pop();
 }
+
+
+bool StreamSynchronizer::try_get_frame_packet(SSFramePacket& frame_packet) {
+    return this->frame_packet_buffer->try_pop(frame_packet);
+}
+
+
+int StreamSynchronizer::get_frame_packet_fd(void) {
+    return this->frame_packet_buffer->fd();
+}
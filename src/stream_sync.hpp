@@ -12,6 +12,9 @@
 #include <cmath>
 #include <numeric>
 #include <functional>
+#include <atomic>
+#include <queue>
+#include <deque>
 
 // OpenCV
 #include <opencv2/opencv.hpp>
@@ -19,33 +22,48 @@
 #include "../../video_cap/src/video_cap_validator.hpp"
 #include "exceptions.hpp"
 #include "shared_queue.hpp"
+#include "encoded_packet_recorder.hpp"
+#include "thread_config.hpp"
+#include "motion_vectors.hpp"
+#include "clock_estimation.hpp"
+#include "frame_data.hpp"
+
+typedef std::vector<std::unique_ptr<SharedQueue<std::shared_ptr<FrameData> > > > SSFrameBuffer;
 
 /*
-*    Combines video frame, motion vectors, timestamp and other data read from the streams
+*    Output policies of the frame packet buffer
 *
 */
 
-#define FRAME_OKAY  0
-#define FRAME_DROPPED  1
-#define FRAME_READ_ERROR  2
-#define CAP_BROKEN  3
-
-struct FrameData {
-    double timestamp;
-    uint8_t *frame;
-    int height;
-    int width;
-    MVS_DTYPE *motion_vectors;
-    MVS_DTYPE num_mvs;
-    char frame_type[2];
-    int frame_status;
+#define OUTPUT_LATEST  0  // a full output buffer drops its oldest frame packet
+#define OUTPUT_LOSSLESS  1  // a full output buffer pauses packet generation until the consumer catches up
+#define CLOCK_CORRECTION_MAX_RATE  0.01  // seconds the clock correction may change per second of arrival time
+
+struct OutputStats {
+    uint64_t dropped_packets;  // frame packets dropped from the output buffer
+    double blocked_time;  // total time in seconds packet generation waited for the consumer
+    std::vector<uint64_t> dropped_frames;  // frames of each stream dropped from its frame buffer or skipped during matching
+    uint64_t suppressed_packets;  // static frame packets suppressed by the motion gate
+    std::vector<uint64_t> unchanged_frames;  // frames of each stream marked FRAME_UNCHANGED by the motion gate
+    uint64_t late_frames;  // frames of the merged output older than a frame passed on before them
 };
 
-typedef std::vector<std::shared_ptr<FrameData> > SSFramePacket;
-typedef std::vector<std::unique_ptr<SharedQueue<std::shared_ptr<FrameData> > > > SSFrameBuffer;
+struct ExportedClip {
+    std::size_t cap_id;
+    std::string path;
+    double timestamp;  // timestamp of the first packet, i.e. of the keyframe preceding the requested start
+};
 
 // need FrameData and SSFramePacket type
 #include "frame_packet_deque.hpp"
+#include "frame_packet_history.hpp"
+#include "shm_packet_ring.hpp"
+#include "packet_dispatcher.hpp"
+#include "packet_recording.hpp"
+#include "worker_pool.hpp"
+#include "preprocessing.hpp"
+#include "mosaic.hpp"
+#include "distributed_sync.hpp"
 
 
 /*
@@ -67,6 +85,149 @@ private:
     SSFrameBuffer frame_buffers;
     std::unique_ptr<FramePacketDeque> frame_packet_buffer;
 
+    /* optional look-back history of recent frame packets */
+    std::size_t history_max_packets = 0;
+    std::size_t history_max_bytes = 0;
+    std::unique_ptr<FramePacketHistory> history;
+
+    /* optional ring of encoded packets per stream for clip export */
+    double packet_ring_duration = 0;
+    std::size_t packet_ring_max_bytes = 0;
+    std::vector<std::unique_ptr<EncodedPacketRecorder> > packet_recorders;
+
+    /* optional shared memory output for consumers in other processes */
+    std::string shm_name;
+    std::size_t shm_num_slots;
+    std::size_t shm_slot_size;
+    std::unique_ptr<ShmPacketWriter> shm_writer;
+
+    /* optional push delivery of frame packets to callbacks */
+    std::size_t num_dispatcher_threads = 1;
+    std::unique_ptr<PacketDispatcher> dispatcher;
+    std::mutex dispatcher_mutex;
+
+    /* creates the dispatcher on first use */
+    void create_dispatcher(void);
+
+    /* optional recording of all frame packets and replay of a recording */
+    std::string recording_path;
+    std::unique_ptr<PacketRecordingWriter> recording_writer;
+    std::unique_ptr<PacketRecordingReader> replay_reader;
+    bool replay_paced;
+
+    /* creates the enabled outputs (history, shared memory, recording, callbacks) */
+    void create_outputs(std::size_t num_streams);
+
+    /* passes a new frame packet to all outputs, if block_if_full is set wait
+    for the consumer instead of dropping the oldest packet in the output buffer */
+    void output_frame_packet(SSFramePacket& frame_packet, double packet_timestamp, bool block_if_full);
+
+    /* passes a frame packet to history, shared memory, recording and callbacks or output buffer */
+    void deliver_frame_packet(SSFramePacket& frame_packet, double packet_timestamp, bool block_if_full);
+
+    /* background thread which reads frame packets from a recording */
+    void replay_frame_packets(void);
+
+    /* optional post-processing of motion vectors */
+    MotionVectorConfig motion_vector_config;
+
+    /* filters motion vectors and creates compact array and motion grid of a frame */
+    void process_motion_vectors(FrameData& frame_data);
+
+    /* optional conversion of every frame packet into a model input tensor and/or a mosaic */
+    PreprocessingConfig preprocessing_config;
+    MosaicConfig mosaic_config;
+    std::unique_ptr<MosaicRenderer> mosaic_renderer;
+    std::unique_ptr<WorkerPool> worker_pool;
+
+    /* preprocesses all frames of the packet on the pool into a new tensor */
+    void preprocess_frame_packet(SSFramePacket& frame_packet);
+
+    /* packets waiting for preprocessing and mosaic, which run on their own
+    thread so that the synchronization thread only queues the packets */
+    struct ProcessItem {
+        SSFramePacket frame_packet;  // empty for the end marker of a replay
+        double packet_timestamp;
+        bool block_if_full;
+    };
+    std::deque<ProcessItem> process_queue;
+    std::size_t process_queue_maxsize = 4;
+    uint64_t process_dropped_packets = 0;
+    double process_blocked_time = 0;
+    std::mutex process_mutex;  // protects the queue and its counters
+    std::condition_variable process_cond;  // signals queued packets and free queue space
+
+    /* queues a frame packet for processing, if block_if_full is set (or the
+    output policy is lossless) wait for free space instead of dropping the oldest packet */
+    void queue_frame_packet(SSFramePacket&& frame_packet, double packet_timestamp, bool block_if_full);
+
+    /* background thread which preprocesses and renders queued packets and delivers them */
+    void process_frame_packets(void);
+
+    /* optional motion gate which skips frames of static scenes */
+    double motion_gate_threshold = 0;
+    bool motion_gate_suppress = false;
+    double motion_gate_max_interval = 0;
+    std::vector<double> gate_last_score;  // score of the preceding frame per stream, used for I frames
+    std::vector<double> gate_last_emitted;  // timestamp of the last frame handed over per stream
+    std::vector<uint64_t> gate_unchanged_frames;
+    uint64_t gate_suppressed_packets = 0;
+    std::mutex gate_mutex;
+
+    /* replaces frames below the motion threshold with FRAME_UNCHANGED markers,
+    returns false if the frame packet is static and should be suppressed */
+    bool gate_frame_packet(SSFramePacket& frame_packet);
+
+    /* online estimation of the clock offset of every stream and optional correction of its timestamps */
+    bool clock_correction = false;
+    int clock_reference = 0;  // cap_id or CLOCK_HOST_REFERENCE
+    double clock_window = 60;
+    std::vector<std::unique_ptr<ClockEstimator> > clock_estimators;
+    std::vector<double> clock_corrections;  // currently applied correction of every stream
+    std::vector<double> clock_correction_times;  // arrival time at which it was applied
+    std::mutex clock_mutex;  // protects the applied corrections
+
+    /* seconds to subtract from timestamps of stream cap_id which arrived at
+    arrival_time, moves towards the change of the offset relative to the
+    reference by at most CLOCK_CORRECTION_MAX_RATE, so that refits of the
+    estimate never reorder the timestamps of a stream */
+    double clock_correction_at(std::size_t cap_id, double arrival_time);
+
+    /* optional output of single frames of all streams in timestamp order instead of frame packets */
+    bool merged_output = false;
+    double merge_reorder_window = 0.2;
+    std::size_t merged_frame_buffer_maxsize = 64;
+    std::unique_ptr<FramePacketDeque> merged_frame_buffer;  // holds packets of a single frame
+    std::unique_ptr<std::atomic<double>[]> newest_pushed_timestamps;  // newest timestamp pushed into every frame buffer
+    std::atomic<uint64_t> merge_late_frames{0};
+
+    /* background thread which merges the frame buffers into one stream ordered by timestamp */
+    void merge_frames(void);
+
+    /* optional distributed synchronization, either as ingest worker which
+    publishes frame metadata or as coordinator which matches the metadata */
+    std::string coordinator_address;
+    int ingest_worker_id = -1;
+    std::size_t ingest_max_pending_frames = 64;
+    std::size_t ingest_max_matched_frames = 32;
+    std::unique_ptr<IngestPublisher> ingest_publisher;
+    std::unique_ptr<CoordinatorServer> coordinator_server;
+
+    /* false if the capture device (or on the coordinator the remote stream) is lost */
+    bool stream_is_valid(std::size_t cap_id);
+
+    /* behaviour of output and frame buffers with a slow consumer */
+    int output_policy = OUTPUT_LATEST;
+    std::size_t frame_buffer_maxsize = 0;
+
+    /* placement and scheduling of the pipeline threads */
+    std::vector<ThreadConfig> reader_thread_configs;  // indexed by cap_id
+    ThreadConfig sync_thread_config;
+    ThreadConfig dispatcher_thread_config;
+
+    /* config of the reader thread of a stream */
+    ThreadConfig reader_thread_config(std::size_t cap_id);
+
     /* for frame buffer rate control */
     std::condition_variable cv;
     std::mutex frame_buffer_mutex;
@@ -90,8 +251,11 @@ private:
     /* condition which returns true once all frame buffers contain the query timestamp */
     bool all_streams_passed_query_time(double query_timestamp);
 
+    /* waits until every stream delivered a frame and checks their initial offset */
+    void wait_for_streams(void);
+
     /* create packets of frame_data which are very close in time (synchronized) */
-    SSFramePacket assemble_frame_packet(double query_timestamp, std::size_t query_cap_id);
+    SSFramePacket assemble_frame_packet(double query_timestamp);
 
     /* background thread which continuosly creates synchronized packets of frames */
     void generate_frame_packets(void);
@@ -117,8 +281,174 @@ public:
         int max_read_errors,
         int frame_packet_buffer_maxsize);
 
+    /* Keep recent frame packets in a timestamp-indexed history for look-back
+    queries, limited by number of packets and/or total bytes (0 means no limit
+    for this quantity), must be called before init */
+    void enable_history(std::size_t max_packets, std::size_t max_bytes = 0);
+
+    /* Retrieve the packet from the history whose timestamp is closest to the
+    given UNIX timestamp, returns false if the history is empty or disabled */
+    bool get_packet_at(double timestamp, SSFramePacket& frame_packet, double& packet_timestamp);
+
+    /* Retrieve all packets from the history with timestamps in [timestamp0, timestamp1] */
+    void get_packets_between(double timestamp0, double timestamp1,
+        std::vector<SSFramePacket>& frame_packets, std::vector<double>& packet_timestamps);
+
+    /* Keep the encoded packets of every stream for the last max_duration
+    seconds (and/or max_bytes per stream) for export with export_clip, must be
+    called before init. Uses an additional demux-only connection per stream. */
+    void enable_packet_ring(double max_duration, std::size_t max_bytes = 0);
+
+    /* Export the time range [timestamp0, timestamp1] of every stream as MP4
+    file <directory>/stream_<cap_id>.mp4 without re-encoding, each clip starts
+    at the keyframe preceding timestamp0. Returns the written clips. */
+    std::vector<ExportedClip> export_clip(double timestamp0, double timestamp1, const std::string& directory);
+
+    /* Publish every frame packet additionally into the POSIX shared memory
+    ring /dev/shm/<shm_name> (see ShmPacketReader), must be called before init */
+    void enable_shm_output(const std::string& shm_name,
+        std::size_t num_slots = 4,
+        std::size_t slot_size = 64 << 20);
+
+    /* Number of threads which invoke frame packet callbacks, must be called
+    before init and before the first callback is registered */
+    void set_dispatcher_threads(std::size_t num_threads);
+
+    /* Deliver every frame packet to the callback on a dispatcher thread instead
+    of the output buffer. At most max_pending packets are queued per callback,
+    further packets replace the oldest queued one. Returns the callback id. */
+    int register_callback(SSFramePacketCallback callback, std::size_t max_pending = 2);
+
+    /* Remove a callback, waits until a running invocation has finished */
+    bool unregister_callback(int callback_id);
+
+    /* Delivery statistics of a callback, returns false if the id is unknown */
+    bool get_callback_stats(int callback_id, CallbackStats& stats);
+
+    /* Post-process the motion vectors of every frame in the reader threads:
+    remove zero-motion vectors, provide a compact float array and/or a dense
+    motion grid (see FrameData), must be called before init */
+    void set_motion_vector_config(const MotionVectorConfig& config);
+
+    /* Convert every frame packet into one batched, normalized float tensor
+    (see PreprocessingConfig) on a pool of worker threads, the tensor is
+    referenced by all frames of the packet. Must be called before init. */
+    void enable_preprocessing(const PreprocessingConfig& config);
+
+    /* Render every frame packet into one downscaled mosaic image for
+    monitoring (see MosaicRenderer), the mosaic is referenced by all frames of
+    the packet. Must be called before init. */
+    void enable_mosaic(const MosaicConfig& config);
+
+    /* Compute a motion score (see motion_score) for every frame and replace
+    frames with a score below threshold by FRAME_UNCHANGED markers without
+    frame data. I frames carry no motion vectors and inherit the score of the
+    preceding frame. The first frame of a stream and, if max_interval > 0, one
+    frame every max_interval seconds are always handed over. If suppress is set,
+    frame packets without any changed frame are not output at all. Must be
+    called before init. */
+    void enable_motion_gate(double threshold, bool suppress = false, double max_interval = 0);
+
+    /* OUTPUT_LATEST (default) or OUTPUT_LOSSLESS. In lossless mode a full output
+    buffer (or with registered callbacks a full callback queue) pauses packet
+    generation instead of dropping the oldest packet, and frames queue up in
+    the per-stream frame buffers meanwhile. Must be called before init. */
+    void set_output_policy(int policy);
+
+    /* Limit every per-stream frame buffer to maxsize frames by dropping the
+    oldest frame, 0 (default) does not limit them. Must be called before init. */
+    void set_frame_buffer_maxsize(std::size_t maxsize);
+
+    /* Counters of dropped frame packets and frames and of the time spent waiting for the consumer */
+    void get_output_stats(OutputStats& stats);
+
+    /* Estimate the clock offset and drift of every stream continuously from
+    frame timestamps and arrival times over the last window seconds (see
+    ClockEstimator), which is always done, and subtract the change of the
+    offset relative to the stream reference (or the host clock for
+    CLOCK_HOST_REFERENCE) since the estimates became valid from every
+    timestamp before matching. Must be called before init. */
+    void enable_clock_correction(int reference = 0, double window = 60);
+
+    /* Output every frame of every stream exactly once in timestamp order
+    instead of frame packets, retrieved with get_next_frame. A frame is passed
+    on once every stream delivered a newer frame, or at the latest once a frame
+    reorder_window seconds newer arrived from any stream. Frames of streams
+    lagging further behind are passed on late (out of order) rather than
+    dropped. The merged output never drops frames, at most buffer_maxsize
+    frames wait for the consumer before merging pauses. Frame packet outputs
+    (history, shared memory, recording, callbacks, preprocessing, mosaic and
+    motion gate) are not served. As frame buffers must not drop frames either,
+    init throws StreamProcessingError if a frame buffer maxsize is set. Must
+    be called before init. */
+    void enable_merged_output(double reorder_window = 0.2, std::size_t buffer_maxsize = 64);
+
+    /* Retrieve the next frame of the merged output if available, otherwise
+    block. FrameData::cap_id holds the stream of the frame. */
+    std::shared_ptr<FrameData> get_next_frame(void);
+
+    /* Run as ingest worker worker_id of a coordinator at "host:port" (see
+    init_coordinator). The metadata of every frame is published to the
+    coordinator instead of synchronizing locally, frames are kept until the
+    coordinator matched or skipped them. Per stream at most max_pending_frames
+    unmatched and the max_matched_frames most recently matched frames are kept
+    for fetching, each holding a decoded frame. No frame packets are output.
+    Must be called before init, which retries connecting for up to 30 seconds. */
+    void enable_ingest_worker(const std::string& coordinator_address, int worker_id,
+        std::size_t max_pending_frames = 64, std::size_t max_matched_frames = 32);
+
+    /* Synchronize the streams of num_workers ingest workers which connect to
+    port, instead of reading from cameras. Blocks until all workers connected.
+    Frame packets contain only metadata (status, frame type, timestamp and
+    sequence number), frames are retrieved with fetch_frames. History and
+    callbacks are supported, other packet outputs not. */
+    void init_coordinator(int port,
+        std::size_t num_workers,
+        double max_initial_stream_offset,
+        int frame_packet_buffer_maxsize);
+
+    /* Fetch frame and motion vectors of all valid frames of a frame packet of
+    the coordinator from the workers. Frames which a worker released already
+    have status FRAME_DROPPED. If a worker can not serve the fetch, it is
+    dropped like a lost worker and its frames have status CAP_BROKEN. */
+    void fetch_frames(const SSFramePacket& frame_packet, SSFramePacket& fetched);
+
+    /* Current clock estimate of every stream, empty for a replay */
+    void get_clock_estimates(std::vector<ClockEstimate>& estimates);
+
+    /* CPU affinity, NUMA node and real-time priority of the thread which reads
+    the stream cap_id (also used for its packet ring connection). The NUMA node
+    determines where the frames of the stream are allocated. Must be called
+    before init. */
+    void set_reader_thread_config(std::size_t cap_id, const ThreadConfig& config);
+
+    /* Config of the thread which synchronizes frame packets (or replays a
+    recording), e.g. a real-time priority for low latency, must be called before init */
+    void set_sync_thread_config(const ThreadConfig& config);
+
+    /* Config of the dispatcher threads, must be called before init and before
+    the first callback is registered */
+    void set_dispatcher_thread_config(const ThreadConfig& config);
+
+    /* Replay the frame packets of a recording instead of reading from cameras.
+    If paced, packets are emitted at the rate they were recorded, otherwise as
+    fast as they are retrieved. An empty packet marks the end of the recording. */
+    void init_replay(const std::string& path,
+        bool paced,
+        int frame_packet_buffer_maxsize);
+
+    /* Append every frame packet to a recording file (and index <path>.idx)
+    which can be replayed with init_replay, must be called before init */
+    void enable_recording(const std::string& path);
+
     /* Retrieve the next synchronized frame packet if available, otherwise block */
     SSFramePacket get_frame_packet(void);
+
+    /* Retrieve the next synchronized frame packet without blocking, returns false if none is available */
+    bool try_get_frame_packet(SSFramePacket& frame_packet);
+
+    /* File descriptor (eventfd) which is readable while frame packets are available, for use with poll/epoll */
+    int get_frame_packet_fd(void);
 };
 
 #endif
@@ -74,9 +74,6 @@ int main () {
             std::stringstream window_name;
             window_name << "frame_" << cap_id;
             cv::imshow(window_name.str(), cv_frame);
-
-            free((*frame_packet[cap_id]).frame);
-            free((*frame_packet[cap_id]).motion_vectors);
         }
         // if user presses "ESC" stop program
         char c=(char)cv::waitKey(1);
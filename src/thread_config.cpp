@@ -0,0 +1,102 @@
+#include "thread_config.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+
+std::vector<int> numa_node_cpus(int numa_node) {
+
+    std::vector<int> cpus;
+
+    // cpulist has the format "0-3,8-11"
+    std::stringstream path;
+    path << "/sys/devices/system/node/node" << numa_node << "/cpulist";
+    std::ifstream file(path.str());
+    std::string range;
+    while(std::getline(file, range, ',')) {
+        int first = 0;
+        int last = 0;
+        int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if(n < 1)
+            continue;
+        if(n == 1)
+            last = first;
+        for(int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+
+static void set_affinity(const std::vector<int>& cpus, const std::string& name) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for(std::size_t i = 0; i < cpus.size(); i++) {
+        if(cpus[i] >= 0 && cpus[i] < CPU_SETSIZE)
+            CPU_SET(cpus[i], &cpu_set);
+    }
+
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if(ret != 0)
+        std::cerr << "Could not set CPU affinity of thread " << name << ": " << strerror(ret) << std::endl;
+}
+
+
+static void set_preferred_numa_node(int numa_node, const std::string& name) {
+    // set_mempolicy is called directly to avoid a dependency on libnuma
+    unsigned long node_mask[16] = {0};
+    const unsigned long bits = 8 * sizeof(unsigned long);
+    if(numa_node < 0 || (unsigned long)numa_node >= 8 * sizeof(node_mask) - 1) {
+        std::cerr << "Invalid NUMA node " << numa_node << " for thread " << name << std::endl;
+        return;
+    }
+    node_mask[numa_node / bits] |= 1UL << (numa_node % bits);
+
+    if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, node_mask, 8 * sizeof(node_mask)) < 0)
+        std::cerr << "Could not set NUMA memory policy of thread " << name << ": " << strerror(errno) << std::endl;
+}
+
+
+static void set_realtime_priority(int priority, const std::string& name) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if(ret != 0)
+        std::cerr << "Could not set real-time priority of thread " << name << ": " << strerror(ret) << std::endl;
+}
+
+
+void apply_thread_config(const ThreadConfig& config, const std::string& name) {
+
+    // the kernel limits thread names to 15 characters
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+    if(!config.cpus.empty()) {
+        set_affinity(config.cpus, name);
+    }
+    else if(config.numa_node >= 0) {
+        std::vector<int> cpus = numa_node_cpus(config.numa_node);
+        if(cpus.empty())
+            std::cerr << "NUMA node " << config.numa_node << " has no CPUs, thread " << name << " is not pinned" << std::endl;
+        else
+            set_affinity(cpus, name);
+    }
+
+    if(config.numa_node >= 0)
+        set_preferred_numa_node(config.numa_node, name);
+
+    if(config.realtime_priority > 0)
+        set_realtime_priority(config.realtime_priority, name);
+}
@@ -0,0 +1,31 @@
+#ifndef THREAD_CONFIG_H
+#define THREAD_CONFIG_H
+
+#include <string>
+#include <vector>
+
+/*
+*    Placement and scheduling of a pipeline thread
+*
+*    Threads are pinned to the given CPUs. If only a NUMA node is given, they
+*    are pinned to the CPUs of that node. Memory allocated by the thread (e.g.
+*    frame buffers of a reader thread) is preferably placed on the NUMA node,
+*    so that frames stay local to the socket of the consumer. A real-time
+*    priority switches the thread to SCHED_FIFO which requires CAP_SYS_NICE.
+*
+*/
+
+struct ThreadConfig {
+    std::vector<int> cpus;  // CPUs the thread may run on, empty for no restriction
+    int numa_node = -1;  // preferred NUMA node for allocations, -1 for the system default
+    int realtime_priority = 0;  // SCHED_FIFO priority in [1, 99], 0 for normal scheduling
+};
+
+/* names the calling thread (at most 15 characters are kept) and applies the
+config, failures are reported on stderr but do not stop the thread */
+void apply_thread_config(const ThreadConfig& config, const std::string& name);
+
+/* CPUs of a NUMA node, empty if the node does not exist */
+std::vector<int> numa_node_cpus(int numa_node);
+
+#endif
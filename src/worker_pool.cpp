@@ -0,0 +1,84 @@
+#include "worker_pool.hpp"
+
+#include <iostream>
+
+
+WorkerPool::WorkerPool(std::size_t num_threads, const ThreadConfig& thread_config, const std::string& name) {
+    this->thread_config = thread_config;
+    this->name = name;
+    this->num_tasks = 0;
+    this->next_task = 0;
+    this->num_done = 0;
+    this->stop = false;
+
+    for(std::size_t i = 0; i < num_threads; i++) {
+        this->threads.push_back(
+            std::thread(&WorkerPool::run, this, i)
+        );
+    }
+}
+
+
+WorkerPool::~WorkerPool() {
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+    this->stop = true;
+    mlock.unlock();
+    this->cond_.notify_all();
+
+    for(std::size_t i = 0; i < this->threads.size(); i++) {
+        this->threads[i].join();
+    }
+}
+
+
+bool WorkerPool::run_next(std::unique_lock<std::mutex>& mlock) {
+    if(this->next_task >= this->num_tasks)
+        return false;
+
+    std::size_t i = this->next_task++;
+    mlock.unlock();
+    try {
+        this->task(i);
+    }
+    catch(const std::exception& e) {
+        std::cerr << "Exception in " << this->name << " worker: " << e.what() << std::endl;
+    }
+    mlock.lock();
+
+    if(++this->num_done == this->num_tasks)
+        this->done_cond_.notify_all();
+    return true;
+}
+
+
+void WorkerPool::run(std::size_t thread_id) {
+    apply_thread_config(this->thread_config, this->name + "_" + std::to_string(thread_id));
+
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+    while(1) {
+        this->cond_.wait(mlock, [this]{return (this->stop || this->next_task < this->num_tasks);});
+        if(this->stop)
+            return;
+        this->run_next(mlock);
+    }
+}
+
+
+void WorkerPool::parallel_for(std::size_t num_tasks, const std::function<void(std::size_t)>& task) {
+    std::unique_lock<std::mutex> mlock(this->mutex_);
+    this->task = task;
+    this->num_tasks = num_tasks;
+    this->next_task = 0;
+    this->num_done = 0;
+    mlock.unlock();
+    this->cond_.notify_all();
+
+    // the calling thread takes part instead of idling
+    mlock.lock();
+    while(this->run_next(mlock)) {}
+    this->done_cond_.wait(mlock, [this]{return this->num_done == this->num_tasks;});
+
+    this->num_tasks = 0;
+    this->next_task = 0;
+    this->task = nullptr;
+}
@@ -0,0 +1,58 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "thread_config.hpp"
+
+/*
+*    Fixed pool of threads which execute the iterations of a parallel loop
+*
+*    parallel_for() hands out the iterations one by one to the pool threads and
+*    the calling thread, and returns once all of them finished. Only one loop
+*    runs at a time, parallel_for() must not be called concurrently.
+*
+*/
+
+class WorkerPool {
+
+private:
+
+    std::vector<std::thread> threads;
+    ThreadConfig thread_config;
+    std::string name;
+
+    std::function<void(std::size_t)> task;
+    std::size_t num_tasks;
+    std::size_t next_task;
+    std::size_t num_done;
+    bool stop;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;  // signals new iterations to the pool threads
+    std::condition_variable done_cond_;  // signals the completion of all iterations
+
+    /* background thread which executes iterations */
+    void run(std::size_t thread_id);
+
+    /* executes the next iteration if any is left (called with mutex_ held, releases it meanwhile) */
+    bool run_next(std::unique_lock<std::mutex>& mlock);
+
+public:
+
+    /* starts num_threads pool threads named <name>_<i> with the given placement */
+    WorkerPool(std::size_t num_threads, const ThreadConfig& thread_config, const std::string& name);
+
+    /* stops and joins the pool threads */
+    ~WorkerPool();
+
+    /* executes task(i) for i in [0, num_tasks) and waits for all iterations */
+    void parallel_for(std::size_t num_tasks, const std::function<void(std::size_t)>& task);
+};
+
+#endif
@@ -0,0 +1,88 @@
+import os
+import sys
+import json
+import time
+import argparse
+import subprocess
+
+import numpy as np
+
+from stream_sync import StreamSynchronizer
+
+
+# Measures the packet latency (time between the capture timestamp of the newest
+# frame in a packet and the retrieval of the packet by the consumer) for
+# different thread placements. Every configuration runs in its own process.
+#
+# Usage: python3 stream_sync_benchmark.py --numa-node 0 rtsp://cam0 rtsp://cam1 ...
+
+
+def node_cpus(numa_node):
+    cpus = []
+    with open("/sys/devices/system/node/node{}/cpulist".format(numa_node)) as f:
+        for cpu_range in f.read().strip().split(","):
+            first, _, last = cpu_range.partition("-")
+            cpus.extend(range(int(first), int(last or first) + 1))
+    return cpus
+
+
+def run(config, sources, numa_node, num_packets):
+    cams = [{"source": source} for source in sources]
+    kwargs = {}
+
+    if config == "pinned":
+        cpus = node_cpus(numa_node)
+        # the real-time synchronizer, the consumer and the readers get CPUs of their own,
+        # so that the synchronizer can not starve the others
+        os.sched_setaffinity(0, cpus[1:2])
+        for cam in cams:
+            cam["numa_node"] = numa_node
+            cam["cpus"] = cpus[2:]
+        kwargs["sync_cpus"] = cpus[:1]
+        kwargs["sync_priority"] = 10
+
+    stream_synchronizer = StreamSynchronizer(cams, **kwargs)
+
+    latencies = []
+    while len(latencies) < num_packets:
+        frame_packet = stream_synchronizer.get_frame_packet()
+        now = time.time()
+        timestamps = [frame_data["timestamp"] for frame_data in frame_packet.values()
+            if frame_data["frame_status"] == "FRAME_OKAY"]
+        if timestamps:
+            latencies.append(now - max(timestamps))
+
+    # skip the startup phase
+    latencies = np.array(latencies[len(latencies) // 10:]) * 1000
+    print(json.dumps({"p50": np.percentile(latencies, 50),
+                      "p99": np.percentile(latencies, 99),
+                      "max": np.max(latencies)}))
+    sys.stdout.flush()
+    os._exit(0)  # background threads of the synchronizer are not joined
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Packet latency with default and pinned thread placement")
+    parser.add_argument("sources", nargs="+", help="stream URLs")
+    parser.add_argument("--numa-node", type=int, default=0, help="NUMA node of the consumer")
+    parser.add_argument("--packets", type=int, default=1000, help="number of frame packets per run")
+    parser.add_argument("--run", choices=["default", "pinned"], help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.run:
+        run(args.run, args.sources, args.numa_node, args.packets)
+
+    configs = ["default", "pinned"]
+    if len(node_cpus(args.numa_node)) < 3:
+        print("NUMA node {} has fewer than 3 CPUs, skipping the pinned run".format(args.numa_node))
+        configs.remove("pinned")
+
+    print("config  | p50 latency | p99 latency | max latency")
+    for config in configs:
+        output = subprocess.run([sys.executable, __file__, "--run", config,
+            "--numa-node", str(args.numa_node), "--packets", str(args.packets)] + args.sources,
+            stdout=subprocess.PIPE, universal_newlines=True).stdout
+        result = json.loads(output.strip().splitlines()[-1])
+        print("{:7s} | {:8.1f} ms | {:8.1f} ms | {:8.1f} ms".format(config,
+            result["p50"], result["p99"], result["max"]))